@@ -0,0 +1,349 @@
+#ifndef _AMP_H
+#define _AMP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include "util.h"
+#include "html.h"
+#include "cache.h"
+#include "config.h"
+#include "entry.h"
+
+// AMP pages of posts, "/<slug>/amp/". They are rendered from the HTML
+// stored with the post when the page cache is filled or the site built,
+// never per request, so they are served like any other cached page. The
+// stored HTML is made AMP-valid here: <img> becomes <amp-img> with its
+// dimensions, what AMP forbids (scripts, frames, forms, inline styles
+// and handlers) is dropped, and the site stylesheet is inlined.
+
+// AMP caps <style amp-custom> at 75,000 bytes.
+const size_t amp_css_limit = 75000;
+
+const char *amp_boilerplate = "<style amp-boilerplate>body{-webkit-animation:-amp-start 8s steps(1,end) 0s 1 normal both;"
+    "-moz-animation:-amp-start 8s steps(1,end) 0s 1 normal both;-ms-animation:-amp-start 8s steps(1,end) 0s 1 normal both;"
+    "animation:-amp-start 8s steps(1,end) 0s 1 normal both}@-webkit-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}"
+    "@-moz-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}@-ms-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}"
+    "@-o-keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}@keyframes -amp-start{from{visibility:hidden}to{visibility:visible}}</style>"
+    "<noscript><style amp-boilerplate>body{-webkit-animation:none;-moz-animation:none;-ms-animation:none;animation:none}</style></noscript>";
+
+// The stylesheet for <style amp-custom>: comments and the "!important"
+// AMP rejects are removed, whitespace runs collapsed. Empty when the file
+// is missing or still over the cap, so the page stays valid unstyled.
+std::string amp_stylesheet(const std::string &file) {
+    std::string css, out;
+    if ( ! read_file(file, css)) {
+        return "";
+    }
+    out.reserve(css.size());
+    for (size_t i = 0; i < css.size(); i++) {
+        if (css.compare(i, 2, "/*") == 0) {
+            size_t end = css.find("*/", i + 2);
+            i = end == std::string::npos ? css.size() : end + 1;
+            continue;
+        }
+        if (strncasecmp(css.c_str() + i, "!important", 10) == 0) {
+            i += 9;
+            continue;
+        }
+        if (isspace((unsigned char)css[i])) {
+            if ( ! out.empty() && out.back() != ' ') {
+                out += ' ';
+            }
+            continue;
+        }
+        out += css[i];
+    }
+    if (out.size() > amp_css_limit) {
+        std::cerr << file << ": " << out.size() << " bytes, over the AMP limit of " << amp_css_limit << std::endl;
+        return "";
+    }
+    return out;
+}
+
+unsigned int read_be16(const unsigned char *p) {
+    return (p[0] << 8) | p[1];
+}
+// Width and height of a PNG, GIF or JPEG file, from its header.
+bool image_size(const std::string &file, int &width, int &height) {
+    std::string data;
+    if ( ! read_file(file, data)) {
+        return false;
+    }
+    const unsigned char *p = (const unsigned char *)data.data();
+    size_t n = data.size();
+    if (n >= 24 && memcmp(p, "\x89PNG\r\n\x1a\n", 8) == 0 && memcmp(p + 12, "IHDR", 4) == 0) {
+        width = (read_be16(p + 16) << 16) | read_be16(p + 18);
+        height = (read_be16(p + 20) << 16) | read_be16(p + 22);
+        return width > 0 && height > 0;
+    }
+    if (n >= 10 && (memcmp(p, "GIF87a", 6) == 0 || memcmp(p, "GIF89a", 6) == 0)) {
+        width = p[6] | (p[7] << 8);
+        height = p[8] | (p[9] << 8);
+        return width > 0 && height > 0;
+    }
+    if (n < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+        return false;
+    }
+    // JPEG: walk the segments to the first start-of-frame
+    size_t i = 2;
+    while (i + 9 < n) {
+        if (p[i] != 0xFF) {
+            return false;
+        }
+        unsigned char marker = p[i + 1];
+        if (marker == 0xFF) {
+            i++;
+            continue;
+        }
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            height = read_be16(p + i + 5);
+            width = read_be16(p + i + 7);
+            return width > 0 && height > 0;
+        }
+        i += 2 + read_be16(p + i + 2);
+    }
+    return false;
+}
+
+typedef std::vector<std::pair<std::string, std::string> > amp_attributes_t;
+
+// Attributes of a start tag, "<img src="a" alt='b' hidden>", lowercased
+// names with their values unquoted but still escaped as in the source.
+std::string parse_tag(std::string_view tag, amp_attributes_t &attrs) {
+    attrs.clear();
+    size_t i = 1, n = tag.size() - 1;
+    std::string name;
+    while (i < n && (isalnum((unsigned char)tag[i]) || tag[i] == '-')) {
+        name += tolower((unsigned char)tag[i++]);
+    }
+    while (i < n) {
+        while (i < n && (isspace((unsigned char)tag[i]) || tag[i] == '/')) {
+            i++;
+        }
+        size_t start = i;
+        while (i < n && ! isspace((unsigned char)tag[i]) && tag[i] != '=' && tag[i] != '/' && tag[i] != '>') {
+            i++;
+        }
+        if (i == start) {
+            break;
+        }
+        std::pair<std::string, std::string> attr;
+        for (size_t j = start; j < i; j++) {
+            attr.first += tolower((unsigned char)tag[j]);
+        }
+        while (i < n && isspace((unsigned char)tag[i])) {
+            i++;
+        }
+        if (i < n && tag[i] == '=') {
+            i++;
+            while (i < n && isspace((unsigned char)tag[i])) {
+                i++;
+            }
+            if (i < n && (tag[i] == '"' || tag[i] == '\'')) {
+                size_t end = tag.find(tag[i], i + 1);
+                end = end == std::string_view::npos || end > n ? n : end;
+                attr.second = tag.substr(i + 1, end - i - 1);
+                i = end + 1;
+            } else {
+                start = i;
+                while (i < n && ! isspace((unsigned char)tag[i])) {
+                    i++;
+                }
+                attr.second = tag.substr(start, i - start);
+            }
+        }
+        attrs.push_back(attr);
+    }
+    return name;
+}
+
+const char *amp_attribute(const amp_attributes_t &attrs, const char *name) {
+    for (auto attr = attrs.begin(); attr != attrs.end(); ++attr) {
+        if (attr->first == name) {
+            return attr->second.c_str();
+        }
+    }
+    return NULL;
+}
+// Elements dropped with everything inside them, and elements whose tags
+// alone are dropped; AMP has no place for either.
+bool amp_drops_content(const std::string &name) {
+    static const char *names[] = { "script", "style", "noscript", "iframe", "frameset", "object", "applet", "form", "video", "audio", "svg", NULL };
+    for (int i = 0; names[i] != NULL; i++) {
+        if (name == names[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool amp_drops_tag(const std::string &name) {
+    static const char *names[] = { "embed", "frame", "param", "base", "link", "meta", "input", "button", "select", "option", "textarea", NULL };
+    for (int i = 0; names[i] != NULL; i++) {
+        if (name == names[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+// <amp-img> needs its dimensions. They come from the tag, else from the
+// file when src is on this site; an image of unknown size keeps its
+// aspect ratio at a fixed height.
+void amp_image(const amp_attributes_t &attrs, const std::string &public_dir, std::string &out) {
+    const char *src = amp_attribute(attrs, "src"), *alt = amp_attribute(attrs, "alt");
+    if (src == NULL || *src == '\0') {
+        return;
+    }
+    const char *w = amp_attribute(attrs, "width"), *h = amp_attribute(attrs, "height");
+    int width = w != NULL ? atoi(w) : 0, height = h != NULL ? atoi(h) : 0;
+    std::string_view path(src);
+    if (path.compare(0, config.domain.size(), config.domain) == 0) {
+        path.remove_prefix(config.domain.size());
+    }
+    if ((width <= 0 || height <= 0) && path.size() > 1 && path[0] == '/' && path[1] != '/') {
+        std::string file = decode_url(path.substr(0, path.find_first_of("?#")));
+        if (file.find("..") == std::string::npos && ! image_size(public_dir + file, width, height)) {
+            width = height = 0;
+        }
+    }
+    out += "<amp-img src=\"";
+    out += src;
+    out += "\"";
+    if (alt != NULL) {
+        out += " alt=\"";
+        out += alt;
+        out += "\"";
+    }
+    if (width > 0 && height > 0) {
+        out += " width=\"" + std::to_string(width) + "\" height=\"" + std::to_string(height) + "\" layout=\"responsive\"";
+    } else {
+        out += " height=\"300\" layout=\"fixed-height\"";
+    }
+    out += "></amp-img>";
+}
+// Rewrites stored post HTML for an AMP page. public_dir is where the
+// site's own images live.
+std::string amp_content(std::string_view html, const std::string &public_dir) {
+    std::string out;
+    out.reserve(html.size());
+    amp_attributes_t attrs;
+    size_t i = 0;
+    while (i < html.size()) {
+        size_t lt = html.find('<', i);
+        if (lt == std::string_view::npos) {
+            out.append(html.substr(i));
+            break;
+        }
+        out.append(html.substr(i, lt - i));
+        // the end of the tag, past quoted '>'
+        size_t end = lt + 1;
+        char quote = 0;
+        for (; end < html.size(); end++) {
+            if (quote) {
+                quote = html[end] == quote ? 0 : quote;
+            } else if (html[end] == '"' || html[end] == '\'') {
+                quote = html[end];
+            } else if (html[end] == '>') {
+                break;
+            }
+        }
+        if (end == html.size()) {
+            // unterminated, left as text
+            out += "&lt;";
+            i = lt + 1;
+            continue;
+        }
+        std::string_view tag = html.substr(lt, end + 1 - lt);
+        i = end + 1;
+        if (tag.size() < 3 || tag[1] == '!' || tag[1] == '?') {
+            // comments and doctypes
+            if (tag.compare(0, 4, "<!--") == 0 && tag.compare(tag.size() - 3, 3, "-->") != 0) {
+                size_t close = html.find("-->", lt + 4);
+                i = close == std::string_view::npos ? html.size() : close + 3;
+            }
+            continue;
+        }
+        bool closing = tag[1] == '/';
+        std::string name = parse_tag(closing ? tag.substr(1) : tag, attrs);
+        if (amp_drops_content(name)) {
+            if ( ! closing && tag[tag.size() - 2] != '/') {
+                std::string close = "</" + name;
+                size_t at = i;
+                while ((at = html.find("</", at)) != std::string_view::npos && strncasecmp(html.data() + at, close.c_str(), close.size()) != 0) {
+                    at += 2;
+                }
+                size_t gt = at == std::string_view::npos ? std::string_view::npos : html.find('>', at);
+                i = gt == std::string_view::npos ? html.size() : gt + 1;
+            }
+            continue;
+        }
+        if (amp_drops_tag(name) || (name == "img" && closing)) {
+            continue;
+        }
+        if (name == "img") {
+            amp_image(attrs, public_dir, out);
+            continue;
+        }
+        if (closing || attrs.empty()) {
+            out.append(tag);
+            continue;
+        }
+        out += '<';
+        out += name;
+        for (auto attr = attrs.begin(); attr != attrs.end(); ++attr) {
+            if (attr->first == "style" || attr->first.compare(0, 2, "on") == 0
+                    || (attr->first == "href" && strncasecmp(attr->second.c_str(), "javascript:", 11) == 0)) {
+                continue;
+            }
+            out += ' ';
+            out += attr->first;
+            out += "=\"";
+            // a single-quoted value may hold '"'
+            for (auto c = attr->second.begin(); c != attr->second.end(); ++c) {
+                if (*c == '"') {
+                    out += "&quot;";
+                } else {
+                    out += *c;
+                }
+            }
+            out += '"';
+        }
+        out += tag[tag.size() - 2] == '/' ? "/>" : ">";
+    }
+    return out;
+}
+// Advertises the AMP page on the post's own page.
+void amp_link(const entry_t &entry) {
+    std::string url;
+    the_entry_url(&entry, config.domain, url);
+    std::cout << "<link rel=\"amphtml\" href=\"" << htmlspecialchars(url) << "amp/\" />";
+}
+// The AMP document of a post; root is the directory the site's public
+// files are served from.
+void render_amp(const entry_t &entry, const std::string &root) {
+    std::string url;
+    the_entry_url(&entry, config.domain, url);
+    std::cout << "<!doctype html><html amp lang=\"en\"><head><meta charset=\"utf-8\" />";
+    std::cout << "<script async src=\"https://cdn.ampproject.org/v0.js\"></script>";
+    std::cout << "<title>" << htmlspecialchars(entry.title) << " - CPP Blog</title>";
+    std::cout << "<link rel=\"canonical\" href=\"" << htmlspecialchars(url) << "\" />";
+    std::cout << "<meta name=\"viewport\" content=\"width=device-width,minimum-scale=1,initial-scale=1\" />";
+    std::cout << "<style amp-custom>" << amp_stylesheet(root + PATH_SEPARATOR + "style.css") << "</style>";
+    std::cout << amp_boilerplate << "</head><body>";
+    std::cout << "<h1><a href=\"" << htmlspecialchars(config.domain) << "/\">This is CPP Blog</a></h1>";
+    std::cout << "<article><h2>" << htmlspecialchars(entry.title) << "</h2><time>" << htmlspecialchars(entry.pubdate) << "</time>";
+    std::cout << amp_content(entry.content, root);
+    render_entry_terms("Categories", the_term_url, entry.category);
+    render_entry_terms("Tags", the_tag_url, entry.tag);
+    std::cout << "</article></body></html>";
+}
+
+#endif
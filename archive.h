@@ -0,0 +1,99 @@
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <stdio.h>
+#include <ctype.h>
+#include <time.h>
+#include <string>
+#include <iostream>
+#include <vector>
+#include "sqlite3.h"
+#include "html.h"
+
+// Months are yyyymm integers, the keys of archive_months. Posts whose
+// pubdate does not parse are counted under month 0 and have no archive.
+typedef struct {
+    int month, count;
+} archive_month_t;
+
+// pubdate ("2020-01-02 10:00:00", UTC) as Unix seconds, the way the
+// migration computes pubtime with strftime('%s'); 0 when it does not parse.
+long long pubdate_time(const std::string &pubdate) {
+    struct tm tm = {};
+    int n = sscanf(pubdate.c_str(), "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (n != 3 && n != 6) {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return (long long)timegm(&tm);
+}
+
+int pubtime_month(long long pubtime) {
+    time_t t = (time_t)pubtime;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return (tm.tm_year + 1900) * 100 + tm.tm_mon + 1;
+}
+// First second of month and of the month after it.
+void month_bounds(int month, long long &since, long long &until) {
+    struct tm tm = {};
+    tm.tm_year = month / 100 - 1900;
+    tm.tm_mon = month % 100 - 1;
+    tm.tm_mday = 1;
+    since = (long long)timegm(&tm);
+    tm.tm_mon++;
+    until = (long long)timegm(&tm);
+}
+
+std::string archive_url(int month) {
+    char buff[16];
+    snprintf(buff, sizeof(buff), "/%04d/%02d/", month / 100, month % 100);
+    return buff;
+}
+// "01/2020", as the archive is titled and linked.
+std::string archive_label(int month) {
+    char buff[16];
+    snprintf(buff, sizeof(buff), "%02d/%04d", month % 100, month / 100);
+    return buff;
+}
+// "/2020/01/" and the pages below it.
+bool is_archive_path(const std::string &path) {
+    if (path.size() < 8 || path[0] != '/' || path[5] != '/') {
+        return false;
+    }
+    for (int i = 1; i < 8; i++) {
+        if (i != 5 && ! isdigit((unsigned char)path[i])) {
+            return false;
+        }
+    }
+    return path.size() == 8 || path[8] == '/';
+}
+// Months that have posts, newest first: one scan of archive_months.
+bool load_months(sqlite3 *db, std::vector<archive_month_t> &months) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT month, post_count FROM archive_months WHERE month > 0 AND post_count > 0 ORDER BY month DESC;", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        archive_month_t month = { sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1) };
+        months.push_back(month);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+// Sidebar of the homepage: every month with posts, with its count.
+void render_months(sqlite3 *db) {
+    std::vector<archive_month_t> months;
+    if ( ! load_months(db, months) || months.empty()) {
+        return;
+    }
+    std::cout << "<aside><ul>";
+    for (auto month = months.begin(); month != months.end(); ++month) {
+        std::cout << "<li><a href=\"" << archive_url(month->month) << "\">" << archive_label(month->month) << "</a> (" << month->count << ")</li>";
+    }
+    std::cout << "</ul></aside>";
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _BACKUP_H
+#define _BACKUP_H
+
+#include <stdio.h>
+#include <string>
+#include <iostream>
+#include "sqlite3.h"
+#include "util.h"
+
+// Copies the live database page by page into file with the backup API.
+// Each step copies pages_per_step pages and holds the read lock only for
+// that long; between steps the writer gets sleep_ms to commit. A commit
+// from another process makes SQLite restart the copy, so the step size is
+// a trade between the pause each step costs the writer and how long the
+// backup needs without being interrupted. The result is a plain database
+// file: restoring is copying it back.
+bool backup_db(sqlite3 *db, const std::string &file, int pages_per_step = 256, int sleep_ms = 10) {
+    sqlite3 *dest = NULL;
+    remove(file.c_str());
+    if (sqlite3_open(file.c_str(), &dest) != SQLITE_OK) {
+        std::cout << "Could not create " << file << ": " << sqlite3_errmsg(dest) << std::endl;
+        sqlite3_close(dest);
+        return false;
+    }
+    sqlite3_backup *backup = sqlite3_backup_init(dest, "main", db, "main");
+    if (backup == NULL) {
+        std::cout << "Could not start backup: " << sqlite3_errmsg(dest) << std::endl;
+        sqlite3_close(dest);
+        return false;
+    }
+    double start = now_ms(), slowest = 0, copying = 0;
+    int steps = 0, restarts = 0, rc, last_remaining = -1;
+    do {
+        double step_start = now_ms();
+        rc = sqlite3_backup_step(backup, pages_per_step);
+        double step_ms = now_ms() - step_start;
+        steps++;
+        copying += step_ms;
+        slowest = step_ms > slowest ? step_ms : slowest;
+        int remaining = sqlite3_backup_remaining(backup);
+        if (last_remaining >= 0 && remaining > last_remaining) {
+            restarts++;
+        }
+        last_remaining = remaining;
+        if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            sqlite3_sleep(sleep_ms);
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+    int pages = sqlite3_backup_pagecount(backup);
+    sqlite3_backup_finish(backup);
+    bool ok = rc == SQLITE_DONE;
+    if ( ! ok) {
+        std::cout << "Backup failed: " << sqlite3_errstr(rc) << std::endl;
+    }
+    sqlite3_close(dest);
+    if ( ! ok) {
+        remove(file.c_str());
+        return false;
+    }
+    std::cout << "Backed up " << pages << " pages in " << now_ms() - start << " ms: " << steps << " steps of " << pages_per_step << " pages, "
+        << copying / steps << " ms average, " << slowest << " ms slowest, " << restarts << " restarts" << std::endl;
+    return true;
+}
+
+#endif
@@ -0,0 +1,501 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "sqlite3.h"
+#include "util.h"
+#include "db.h"
+#include "search.h"
+#include "terms.h"
+#include "entry.h"
+#include "listing.h"
+#include "category.h"
+#include "tag.h"
+#include "slug.h"
+#include "utf8.h"
+#include "dump.h"
+
+// Opens a benchmark connection either through db_open() or the way
+// cppblog opened its database before it had a connection layer: default
+// flags, rollback journal and default page cache.
+sqlite3 *bench_open(const std::string &file, db_role_t role, bool tuned) {
+    if (tuned) {
+        return db_open(file, role);
+    }
+    sqlite3 *db = NULL;
+    if (sqlite3_open(file.c_str(), &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        return NULL;
+    }
+    // without it the old setup would mostly measure SQLITE_BUSY errors
+    sqlite3_busy_timeout(db, 5000);
+    return db;
+}
+
+bool bench_fill(const std::string &file, bool tuned, int posts) {
+    remove(file.c_str());
+    remove((file + "-wal").c_str());
+    remove((file + "-shm").c_str());
+    remove((file + "-journal").c_str());
+    sqlite3 *db = bench_open(file, DB_WRITER, tuned);
+    bool ok = db != NULL && register_search_tokenizer(db) && db_migrate(db)
+        && (tuned || db_exec(db, "PRAGMA journal_mode = DELETE;"));
+    std::string sql = "BEGIN; WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(posts) + ")"
+        " INSERT INTO posts (title, slug, excerpt, content, pubdate, tags) SELECT 'Post ' || i, 'post-' || i, 'Excerpt ' || i,"
+        " printf('%.*c', 2000, 'x'), datetime(1600000000 + i * 600, 'unixepoch'), '' FROM n; COMMIT;";
+    ok = ok && db_exec(db, sql.c_str());
+    sqlite3_close(db);
+    return ok;
+}
+// Child process: looks posts up by slug, as the router does, until the
+// deadline and writes to fd how many lookups succeeded and failed.
+void bench_reader(const std::string &file, bool tuned, int posts, double deadline, int fd) {
+    long long done[3] = { 0, 0, 0 };
+    sqlite3 *db = bench_open(file, DB_READER, tuned);
+    sqlite3_stmt *stmt = NULL;
+    if (db != NULL && sqlite3_prepare_v2(db, "SELECT id, title, content FROM posts WHERE slug = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        unsigned int seed = getpid();
+        while (now_ms() < deadline) {
+            std::string slug = "post-" + std::to_string(1 + rand_r(&seed) % posts);
+            sqlite3_bind_text(stmt, 1, slug.c_str(), slug.size(), SQLITE_TRANSIENT);
+            int rc = sqlite3_step(stmt);
+            done[rc == SQLITE_ROW ? 0 : 1]++;
+            sqlite3_reset(stmt);
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    if (write(fd, done, sizeof(done)) != sizeof(done)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+// Child process: one small committed write after another, reported like
+// the reads but flagged as the writer's.
+void bench_writer(const std::string &file, bool tuned, int posts, double deadline, int fd) {
+    long long done[3] = { 0, 0, 1 };
+    sqlite3 *db = bench_open(file, DB_WRITER, tuned);
+    sqlite3_stmt *stmt = NULL;
+    if (db != NULL && sqlite3_prepare_v2(db, "UPDATE posts SET pubdate = datetime('now') WHERE id = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        unsigned int seed = getpid();
+        while (now_ms() < deadline) {
+            sqlite3_bind_int(stmt, 1, 1 + rand_r(&seed) % posts);
+            done[sqlite3_step(stmt) == SQLITE_DONE ? 0 : 1]++;
+            sqlite3_reset(stmt);
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    if (write(fd, done, sizeof(done)) != sizeof(done)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+// Read QPS of several reader processes while one writer keeps committing,
+// on a scratch database so the real one is left alone. tuned picks the
+// connection layer in db.h, otherwise the old defaults.
+bool bench_reads(const std::string &file, int seconds, bool tuned) {
+    const int readers = 4, posts = 10000;
+    if ( ! bench_fill(file, tuned, posts)) {
+        std::cout << "Could not create " << file << std::endl;
+        return false;
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    double deadline = now_ms() + seconds * 1000.0;
+    for (int i = 0; i <= readers; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            if (i == readers) {
+                bench_writer(file, tuned, posts, deadline, fds[1]);
+            }
+            bench_reader(file, tuned, posts, deadline, fds[1]);
+        }
+        if (pid < 0) {
+            return false;
+        }
+    }
+    close(fds[1]);
+    long long reads = 0, read_errors = 0, writes = 0, write_errors = 0, done[3];
+    while (read(fds[0], done, sizeof(done)) == sizeof(done)) {
+        (done[2] ? writes : reads) += done[0];
+        (done[2] ? write_errors : read_errors) += done[1];
+    }
+    close(fds[0]);
+    while (wait(NULL) > 0) {
+    }
+    std::cout << (tuned ? "WAL, read-only readers: " : "rollback journal, defaults: ")
+        << readers << " readers " << reads / seconds << " reads/s (" << read_errors << " failed), "
+        << "1 writer " << writes / seconds << " writes/s (" << write_errors << " failed)" << std::endl;
+    return true;
+}
+// Resolving term slugs, as the router does for /tu-khoa/<slug>/: through
+// term_dictionary, through a prepared statement on the terms_slug index,
+// and through row_exists() which prepares one per lookup. An in-memory
+// database with count terms keeps disk reads out of the sqlite numbers.
+bool bench_terms(int count, int rounds) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    std::string sql = "CREATE TABLE terms ( id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL, slug TEXT NOT NULL, post_count INTEGER NOT NULL DEFAULT 0 );"
+        "CREATE INDEX terms_slug ON terms (slug);"
+        "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(count) + ")"
+        " INSERT INTO terms (name, slug, post_count) SELECT 'Term ' || i, 'term-' || i, i FROM n;";
+    std::vector<term_t> terms;
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK || ! db_exec(db, sql.c_str()) || ! load_terms(db, terms)
+            || sqlite3_prepare_v2(db, "SELECT 1 FROM terms WHERE slug = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        sqlite3_close(db);
+        return false;
+    }
+    // every term, and as many slugs that are not terms
+    std::vector<std::string> slugs;
+    for (auto term = terms.begin(); term != terms.end(); ++term) {
+        slugs.push_back(term->slug);
+        slugs.push_back(term->slug + "x");
+    }
+    term_dictionary dictionary(db);
+    double start = now_ms();
+    bool built = dictionary.build(terms);
+    double build_ms = now_ms() - start;
+    long long found[3] = { 0, 0, 0 };
+    double ms[3];
+    for (int method = 0; method < 3; method++) {
+        start = now_ms();
+        for (int round = 0; round < rounds; round++) {
+            for (auto slug = slugs.begin(); slug != slugs.end(); ++slug) {
+                if (method == 0) {
+                    found[0] += dictionary.lookup(*slug) != NULL;
+                } else if (method == 1) {
+                    sqlite3_bind_text(stmt, 1, slug->c_str(), slug->size(), SQLITE_STATIC);
+                    found[1] += sqlite3_step(stmt) == SQLITE_ROW;
+                    sqlite3_reset(stmt);
+                } else {
+                    found[2] += row_exists(db, "SELECT 1 FROM terms WHERE slug = ?;", *slug);
+                }
+            }
+        }
+        ms[method] = now_ms() - start;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    double lookups = (double)slugs.size() * rounds;
+    std::cout << count << " terms, " << (long long)lookups << " lookups (half of them misses), hash built in " << build_ms << " ms" << std::endl
+        << "  perfect hash:       " << ms[0] * 1e6 / lookups << " ns/lookup, " << found[0] << " found" << std::endl
+        << "  prepared statement: " << ms[1] * 1e6 / lookups << " ns/lookup, " << found[1] << " found" << std::endl
+        << "  row_exists():       " << ms[2] * 1e6 / lookups << " ns/lookup, " << found[2] << " found" << std::endl;
+    return built && found[0] == found[1] && found[1] == found[2];
+}
+
+// Encodes and decodes slugs the way links and routes do: each into a new
+// string, and appended to one reused buffer. Half the slugs are ASCII,
+// half keep their Vietnamese letters and so are mostly escapes.
+bool bench_urls(int count, int rounds) {
+    std::vector<std::string> slugs, encoded;
+    for (int i = 0; i < count; i++) {
+        slugs.push_back(i % 2 == 0 ? "bai-viet-so-" + std::to_string(i) + "-toi-uu-hieu-nang" : "bài-viết-số-" + std::to_string(i) + "-tối-ưu-hiệu-năng");
+        encoded.push_back(encode_url(slugs.back()));
+    }
+    bool ok = true;
+    for (int i = 0; i < count; i++) {
+        ok = ok && decode_url(encoded[i]) == slugs[i];
+    }
+    size_t bytes = 0;
+    double ms[4];
+    std::string buffer;
+    for (int method = 0; method < 4; method++) {
+        double start = now_ms();
+        for (int round = 0; round < rounds; round++) {
+            for (int i = 0; i < count; i++) {
+                if (method == 0) {
+                    bytes += encode_url(slugs[i]).size();
+                } else if (method == 1) {
+                    buffer.clear();
+                    encode_url_to(slugs[i], buffer);
+                    bytes += buffer.size();
+                } else if (method == 2) {
+                    bytes += decode_url(encoded[i]).size();
+                } else {
+                    buffer.clear();
+                    decode_url_to(encoded[i], buffer);
+                    bytes += buffer.size();
+                }
+            }
+        }
+        ms[method] = now_ms() - start;
+    }
+    double calls = (double)count * rounds;
+    std::cout << count << " slugs, " << (long long)calls << " calls each (" << bytes << " bytes out)" << std::endl
+        << "  encode_url():    " << ms[0] * 1e6 / calls << " ns/slug" << std::endl
+        << "  encode_url_to(): " << ms[1] * 1e6 / calls << " ns/slug" << std::endl
+        << "  decode_url():    " << ms[2] * 1e6 / calls << " ns/slug" << std::endl
+        << "  decode_url_to(): " << ms[3] * 1e6 / calls << " ns/slug" << std::endl;
+    return ok;
+}
+
+// Collects what the renderers write to std::cout, keeping its buffer
+// from one page to the next.
+class bench_sink : public std::streambuf {
+    public:
+        std::string out;
+    protected:
+        int_type overflow(int_type c) override {
+            if (c != traits_type::eof()) {
+                out += traits_type::to_char_type(c);
+            }
+            return traits_type::not_eof(c);
+        }
+        std::streamsize xsputn(const char *s, std::streamsize n) override {
+            out.append(s, n);
+            return n;
+        }
+};
+// The links of a page through the real renderers: render_entry_terms()
+// for posts with their categories and tags, timed against the markup
+// built the way it was before, a new string per link, and render_listing()
+// over a scratch database of posts. The term links must come out the
+// same both ways.
+bool bench_links(const std::string &file, int posts, int terms, int rounds) {
+    std::vector<entry_t> entries(posts);
+    for (int i = 0; i < posts; i++) {
+        for (int j = 0; j < terms; j++) {
+            term_t term;
+            term.slug = "tu-khoa-" + std::to_string(j);
+            term.name = "Từ khóa " + std::to_string(j);
+            (j % 2 == 0 ? entries[i].category : entries[i].tag).push_back(term);
+        }
+    }
+    bench_sink sink;
+    std::string old;
+    double ms[3];
+    for (int method = 0; method < 2; method++) {
+        double start = now_ms();
+        for (int round = 0; round < rounds; round++) {
+            (method == 1 ? sink.out : old).clear();
+            for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+                if (method == 1) {
+                    std::streambuf *saved = std::cout.rdbuf(&sink);
+                    render_entry_terms("Categories", the_term_url, entry->category);
+                    render_entry_terms("Tags", the_tag_url, entry->tag);
+                    std::cout.rdbuf(saved);
+                    continue;
+                }
+                const char *labels[] = { "Categories", "Tags" }, *bases[] = { "/chuyen-muc/", "/tu-khoa/" };
+                const std::vector<term_t> *lists[] = { &entry->category, &entry->tag };
+                for (int k = 0; k < 2; k++) {
+                    if (lists[k]->empty()) {
+                        continue;
+                    }
+                    old += "<p>" + std::string(labels[k]) + ": ";
+                    for (auto term = lists[k]->begin(); term != lists[k]->end(); ++term) {
+                        std::string url = encode_url(term->slug);
+                        old += (term == lists[k]->begin() ? "" : ", ") + std::string("<a href=\"") + bases[k] + htmlspecialchars(url) + "/\">"
+                            + htmlspecialchars(term->name) + "</a>";
+                    }
+                    old += "</p>";
+                }
+            }
+        }
+        ms[method] = now_ms() - start;
+    }
+    bool same = sink.out == old;
+    if ( ! bench_fill(file, true, std::max(posts, 11))) {
+        std::cout << "Could not create " << file << std::endl;
+        return false;
+    }
+    sqlite3 *db = db_open(file, DB_READER);
+    bool ok = db != NULL;
+    double start = now_ms();
+    for (int round = 0; ok && round < rounds; round++) {
+        sink.out.clear();
+        std::streambuf *saved = std::cout.rdbuf(&sink);
+        render_listing(db, "/", "", 0, 0, false);
+        std::cout.rdbuf(saved);
+    }
+    ms[2] = now_ms() - start;
+    ok = ok && sink.out.find("<a href=\"/post-") != std::string::npos;
+    sqlite3_close(db);
+    double pages = rounds;
+    std::cout << posts << " posts with " << terms << " terms each, " << rounds << " pages" << std::endl
+        << "  term links, string per link:   " << ms[0] * 1e3 / pages << " us/page" << std::endl
+        << "  term links, render_entry_terms: " << ms[1] * 1e3 / pages << " us/page (" << (same ? "same" : "different") << " markup)" << std::endl
+        << "  render_listing(), first page:  " << ms[2] * 1e3 / pages << " us/page" << std::endl;
+    return ok && same;
+}
+
+// Slugs titles drawn at random from Vietnamese and technical words, the
+// way fold_text() plus a pass replacing spaces did it and with
+// slugify_to() into a reused buffer, then times unique_slug() against a
+// table of posts already holding half of those slugs.
+bool bench_slugs(int titles, int rounds) {
+    const char *words[] = { "Tối", "ưu", "hiệu", "năng", "cơ", "sở", "dữ", "liệu", "SQLite", "cho", "blog", "viết", "bằng", "C++",
+        "và", "CGI", "Hướng", "dẫn", "cài", "đặt", "máy", "chủ", "Nginx", "trên", "Linux", "mới", "nhất", "năm", "2020" };
+    const int word_count = sizeof(words) / sizeof(words[0]);
+    unsigned int seed = 1;
+    std::vector<std::string> texts;
+    size_t bytes = 0;
+    for (int i = 0; i < titles; i++) {
+        std::string title;
+        for (int j = 0, n = 4 + rand_r(&seed) % 10; j < n; j++) {
+            title += (j > 0 ? " " : "") + std::string(words[rand_r(&seed) % word_count]);
+        }
+        bytes += title.size();
+        texts.push_back(title);
+    }
+    double ms[2];
+    std::string buffer, folded;
+    bool same = true;
+    for (int method = 0; method < 2; method++) {
+        double start = now_ms();
+        for (int round = 0; round < rounds; round++) {
+            for (auto text = texts.begin(); text != texts.end(); ++text) {
+                if (method == 0) {
+                    folded.clear();
+                    fold_text(text->data(), text->size(), folded);
+                    std::replace(folded.begin(), folded.end(), ' ', '-');
+                } else {
+                    buffer.clear();
+                    slugify_to(*text, buffer);
+                    same = same && (round > 0 || buffer == slugify(*text));
+                }
+            }
+        }
+        ms[method] = now_ms() - start;
+    }
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    bool ok = sqlite3_open(":memory:", &db) == SQLITE_OK
+        && db_exec(db, "CREATE TABLE posts ( id INTEGER PRIMARY KEY, title TEXT NOT NULL, slug TEXT NOT NULL ); CREATE UNIQUE INDEX posts_slug ON posts (slug);")
+        && sqlite3_prepare_v2(db, "INSERT INTO posts (title, slug) VALUES (?, ?);", -1, &stmt, NULL) == SQLITE_OK;
+    for (int i = 0; ok && i < titles; i += 2) {
+        std::string slug = unique_slug(db, "posts", slugify(texts[i]));
+        sqlite3_bind_text(stmt, 1, texts[i].c_str(), texts[i].size(), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, slug.c_str(), slug.size(), SQLITE_STATIC);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    double start = now_ms();
+    size_t numbered = 0;
+    for (int i = 0; ok && i < titles; i++) {
+        std::string slug = unique_slug(db, "posts", slugify(texts[i]));
+        ok = ! slug.empty();
+        numbered += slug != slugify(texts[i]);
+    }
+    double unique_ms = now_ms() - start;
+    sqlite3_close(db);
+    double mb = (double)bytes * rounds / 1e6;
+    std::cout << titles << " titles, " << bytes / titles << " bytes on average" << std::endl
+        << "  fold_text() and replace: " << mb / ms[0] * 1000 << " MB/s" << std::endl
+        << "  slugify_to():            " << mb / ms[1] * 1000 << " MB/s" << std::endl
+        << "  unique_slug():           " << unique_ms * 1000 / titles << " us/slug, " << numbered << " numbered" << std::endl;
+    return ok && same;
+}
+
+// Runs the ingest checks over a few MB of post-like text: ASCII, Vietnamese
+// in NFC, the same decomposed, and with a stray byte every 4 KB.
+bool bench_utf8(int megabytes, int rounds) {
+    const std::string ascii_words = "Toi uu hieu nang co so du lieu SQLite cho blog viet bang C va CGI. ";
+    const std::string nfc_words = "Tối ưu hiệu năng cơ sở dữ liệu SQLite cho blog viết bằng C và CGI. ";
+    // the same sentence with its letters decomposed, as macOS writes it
+    const std::string nfd_words = "To\xcc\x82\xcc\x81i u\xcc\x9bu hie\xcc\x82\xcc\xa3u na\xcc\x86ng co\xcc\x9b so\xcc\x9b\xcc\x89 du\xcc\x9b\xcc\x83 lie\xcc\x82\xcc\xa3u SQLite"
+        " cho blog vie\xcc\x82\xcc\x81t ba\xcc\x86\xcc\x80ng C va\xcc\x80 CGI. ";
+    const std::string *words[] = { &ascii_words, &nfc_words, &nfd_words, &nfc_words };
+    const char *names[] = { "ASCII", "Vietnamese NFC", "Vietnamese NFD", "NFC, bad bytes" };
+    size_t size = (size_t)megabytes << 20;
+    bool ok = true;
+    for (int kind = 0; kind < 4; kind++) {
+        std::string text;
+        while (text.size() < size) {
+            text += *words[kind];
+        }
+        for (size_t at = 4096; kind == 3 && at < text.size(); at += 4096) {
+            text[at] = (char)0xFF;
+        }
+        double ms[3] = { 0, 0, 0 };
+        size_t valid = 0, repaired = 0;
+        for (int round = 0; round < rounds; round++) {
+            std::string copy = text;
+            double start = now_ms();
+            valid = utf8_valid_length(copy);
+            ms[0] += now_ms() - start;
+            start = now_ms();
+            repaired = utf8_repair(copy);
+            ms[1] += now_ms() - start;
+            start = now_ms();
+            nfc_vietnamese(copy);
+            ms[2] += now_ms() - start;
+            if (kind == 2) {
+                ok = ok && copy.size() < text.size() && utf8_valid_length(copy) == copy.size();
+            }
+        }
+        ok = ok && (kind == 3 ? valid < text.size() && repaired > 0 : valid == text.size() && repaired == 0);
+        double mb = (double)text.size() * rounds / 1e6;
+        // validating the text with bad bytes stops at the first one
+        std::cout << names[kind] << ": validate " << (kind == 3 ? 0 : mb / ms[0] * 1000) << " MB/s, repair " << mb / ms[1] * 1000
+            << " MB/s (" << repaired << " replaced), NFC " << mb / ms[2] * 1000 << " MB/s" << std::endl;
+    }
+    return ok;
+}
+
+// The first row of sql as text, columns joined with '|'; empty when the
+// query fails or returns nothing.
+std::string bench_row(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt = NULL;
+    std::string row;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        for (int i = 0; i < sqlite3_column_count(stmt); i++) {
+            const char *text = (const char*)sqlite3_column_text(stmt, i);
+            row += (i > 0 ? "|" : "") + std::string(text != NULL ? text : "");
+        }
+    }
+    sqlite3_finalize(stmt);
+    return row;
+}
+// Dumps a scratch database of posts and restores the dump, timing both,
+// then checks the copy against the original: the schema version, the
+// rows, the options of the search index in posts_fts_config and what a
+// search finds, in rank order.
+bool bench_dump(const std::string &file, int posts, int jobs) {
+    const char *checks[] = {
+        "PRAGMA user_version;",
+        "SELECT count(*), max(id), sum(length(content)) FROM posts;",
+        "SELECT group_concat(k || '=' || v, ';') FROM (SELECT k, v FROM posts_fts_config ORDER BY k);",
+        "SELECT group_concat(rowid) FROM (SELECT rowid FROM posts_fts WHERE posts_fts MATCH 'post 7*' ORDER BY rank LIMIT 20);"
+    };
+    std::string dump = file + ".sql", copy = file + ".restore";
+    if ( ! bench_fill(file, true, posts)) {
+        std::cout << "Could not create " << file << std::endl;
+        return false;
+    }
+    double start = now_ms();
+    bool ok = dump_db(file, dump, jobs);
+    double dump_ms = now_ms() - start;
+    remove(copy.c_str());
+    sqlite3 *restored = NULL;
+    ok = ok && sqlite3_open(copy.c_str(), &restored) == SQLITE_OK && register_search_tokenizer(restored);
+    start = now_ms();
+    ok = ok && restore_db(restored, dump);
+    double restore_ms = now_ms() - start;
+    sqlite3 *original = db_open(file, DB_READER);
+    ok = ok && original != NULL && register_search_tokenizer(original);
+    for (size_t i = 0; ok && i < sizeof(checks) / sizeof(checks[0]); i++) {
+        std::string expected = bench_row(original, checks[i]), found = bench_row(restored, checks[i]);
+        if (expected.empty() || found != expected) {
+            std::cout << checks[i] << std::endl << "  original: " << expected << std::endl << "  restored: " << found << std::endl;
+            ok = false;
+        }
+    }
+    sqlite3_close(original);
+    sqlite3_close(restored);
+    std::cout << posts << " posts, " << jobs << " jobs: dump " << dump_ms << " ms, restore " << restore_ms << " ms, "
+        << (ok ? "restored copy matches" : "restored copy differs") << std::endl;
+    return ok;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <atomic>
+#include "util.h"
+#include "http.h"
+#include "compress.h"
+#include "minify.h"
+
+// A rendered page together with its pre-compressed variants. The same
+// layout is used by the CGI output cache under datas/cache and by the
+// static build, so nginx gzip_static/brotli_static can serve either one.
+typedef struct {
+    std::string identity, gzip, brotli;
+} page_variants_t;
+
+const char *variant_suffix(content_coding_t coding) {
+    switch (coding) {
+        case CODING_GZIP: return ".gz";
+        case CODING_BROTLI: return ".br";
+        default: return "";
+    }
+}
+// Maps a request URI to the file holding its identity variant:
+// "/" -> root/index.html, "/slug/" -> root/slug/index.html and
+// "/sitemap.xml" -> root/sitemap.xml. Returns an empty string for URIs
+// that are not canonical or must never be mapped on disk.
+std::string page_path(const std::string &root, const std::string &uri) {
+    std::string path = uri.substr(0, uri.find('?'));
+    decode_url_in_place(path);
+    if (path.empty() || path[0] != '/' || path.find("..") != std::string::npos || path.find('\0') != std::string::npos) {
+        return "";
+    }
+    size_t slash = path.find_last_of('/');
+    if (slash == path.size() - 1) {
+        path += "index.html";
+    } else if (path.find('.', slash) == std::string::npos) {
+        // "/slug" is not canonical, it must reach the router to be redirected
+        return "";
+    }
+    std::string dir = root;
+    return rtrim(dir, "/") + path;
+}
+
+bool page_compress(page_variants_t &page) {
+    if ( ! gzip_compress(page.identity, page.gzip)) {
+        return false;
+    }
+    brotli_compress(page.identity, page.brotli);
+    return true;
+}
+
+// Work done once per page when it is filled into the cache or built, never
+// per hit: optional minification, then the compressed variants.
+bool page_fill(page_variants_t &page, bool minify) {
+    if (minify) {
+        page.identity = minify_html(page.identity);
+    }
+    return page_compress(page);
+}
+
+// A name beside path that no other writer uses: CGI processes filling
+// the same page at once, or --serve threads, each get their own, so one
+// never truncates or renames a file another is still writing.
+std::string temp_path(const std::string &path) {
+    static std::atomic<unsigned long> next(0);
+    return path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(next++);
+}
+
+bool write_file(const std::string &path, const std::string &data) {
+    // write beside the target and rename so readers never see half a page
+    std::string tmp = temp_path(path);
+    FILE *fp = fopen(tmp.c_str(), "wbx");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool read_file(const std::string &path, std::string &data) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    data.clear();
+    char buff[16384];
+    size_t n;
+    while ((n = fread(buff, 1, sizeof(buff), fp)) > 0) {
+        data.append(buff, n);
+    }
+    bool ok = ferror(fp) == 0;
+    fclose(fp);
+    return ok;
+}
+
+bool page_store(const std::string &root, const std::string &uri, const page_variants_t &page) {
+    std::string path = page_path(root, uri);
+    if (path.empty()) {
+        return false;
+    }
+    if ( ! mkdirAll(path.substr(0, path.find_last_of(PATH_SEPARATOR)))) {
+        return false;
+    }
+    // the compressed copies go first so a reader that finds the identity
+    // file also finds its variants
+    if ( ! page.brotli.empty() && ! write_file(path + ".br", page.brotli)) {
+        return false;
+    }
+    if ( ! page.gzip.empty() && ! write_file(path + ".gz", page.gzip)) {
+        return false;
+    }
+    return write_file(path, page.identity);
+}
+// Loads the best stored variant for coding, falling back to identity when
+// the preferred one was not stored. coding is updated to what was loaded.
+bool page_load(const std::string &root, const std::string &uri, content_coding_t &coding, std::string &body) {
+    std::string path = page_path(root, uri);
+    // the identity file is written last and purged first, so it decides
+    // whether the page is cached at all
+    if (path.empty() || ! file_exists(path)) {
+        return false;
+    }
+    if (coding != CODING_IDENTITY && read_file(path + variant_suffix(coding), body)) {
+        return true;
+    }
+    if (coding == CODING_BROTLI && read_file(path + ".gz", body)) {
+        coding = CODING_GZIP;
+        return true;
+    }
+    coding = CODING_IDENTITY;
+    return read_file(path, body);
+}
+
+// Validators of the stored page, from one stat() of its identity file,
+// which is rewritten whenever the page is: the mtime and size make the
+// ETag, and the variant coding resolves to (as page_load() would pick it)
+// is part of it since each variant has its own bytes. False when the page
+// is not stored.
+bool page_validators(const std::string &root, const std::string &uri, content_coding_t &coding, std::string &etag, time_t &modified) {
+    std::string path = page_path(root, uri);
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    if (coding == CODING_BROTLI && ! file_exists(path + ".br")) {
+        coding = CODING_GZIP;
+    }
+    if (coding == CODING_GZIP && ! file_exists(path + ".gz")) {
+        coding = CODING_IDENTITY;
+    }
+    char buff[64];
+    snprintf(buff, sizeof(buff), "\"%llx-%llx%s%s\"", (unsigned long long)st.st_mtime, (unsigned long long)st.st_size,
+        coding == CODING_IDENTITY ? "" : "-", coding == CODING_IDENTITY ? "" : coding_name(coding));
+    etag = buff;
+    modified = st.st_mtime;
+    return true;
+}
+
+const std::string &page_variant(const page_variants_t &page, content_coding_t &coding) {
+    if (coding == CODING_BROTLI && ! page.brotli.empty()) {
+        return page.brotli;
+    }
+    if (coding != CODING_IDENTITY && ! page.gzip.empty()) {
+        coding = CODING_GZIP;
+        return page.gzip;
+    }
+    coding = CODING_IDENTITY;
+    return page.identity;
+}
+
+void page_purge(const std::string &root, const std::string &uri) {
+    std::string path = page_path(root, uri);
+    if (path.empty()) {
+        return;
+    }
+    remove(path.c_str());
+    remove((path + ".gz").c_str());
+    remove((path + ".br").c_str());
+}
+
+#endif
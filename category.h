@@ -4,9 +4,13 @@
 #include <string>
 #include "util.h"
 
-std::string the_term_url(term_t *t, std::string domain) {
-    domain = rtrim(domain, "/");
-    return domain + t->slug + "/";
+// Appends the URL of a category's listing to out. domain is
+// config.domain, which config_set() leaves without a trailing slash, or
+// "" for a root-relative link.
+void the_term_url(const term_t *t, std::string_view domain, std::string &out) {
+    out.append(domain).append("/chuyen-muc/");
+    encode_url_to(t->slug, out);
+    out += '/';
 }
 
 #endif
\ No newline at end of file
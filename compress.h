@@ -0,0 +1,51 @@
+#ifndef _COMPRESS_H
+#define _COMPRESS_H
+
+#include <string>
+#include <zlib.h>
+#ifndef NO_BROTLI
+#include <brotli/encode.h>
+#endif
+
+// Pages are compressed once when they are stored, so spend the CPU on the
+// best ratio the encoders offer instead of the fast levels used on the fly.
+bool gzip_compress(const std::string &in, std::string &out, int level = Z_BEST_COMPRESSION) {
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    // 15 window bits + 16 selects the gzip wrapper instead of raw zlib
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+bool brotli_compress(const std::string &in, std::string &out, int quality = 11) {
+#ifndef NO_BROTLI
+    size_t len = BrotliEncoderMaxCompressedSize(in.size());
+    if (len == 0) {
+        return false;
+    }
+    out.resize(len);
+    if ( ! BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, in.size(), (const uint8_t *)in.data(), &len, (uint8_t *)&out[0])) {
+        out.clear();
+        return false;
+    }
+    out.resize(len);
+    return true;
+#else
+    out.clear();
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef _CONFIG_H
+#define _CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "util.h"
+
+// Site settings read from cppblog.ini next to the executable. The CGI and
+// the command line tools (build, purge, ...) load the same file so they
+// agree on URLs and cache locations.
+typedef struct {
+    // scheme and host, without a trailing slash
+    std::string domain;
+    bool minify, stream;
+    // seconds browsers may keep a page, and seconds nginx may keep it
+    int entry_max_age, entry_accel_expires;
+    int listing_max_age, listing_accel_expires;
+    // where nginx keeps fastcgi_cache entries and how it names them; an
+    // empty path disables nginx purging
+    std::string nginx_cache_path, nginx_cache_levels, nginx_cache_key;
+    // megabytes of posts --serve keeps hydrated in memory, 0 for none,
+    // and whether it logs the cache's counters now and then
+    int entry_cache_mb;
+    bool entry_cache_stats;
+    // imported files that are not valid UTF-8 are repaired rather than
+    // refused; Vietnamese typed with combining marks is composed to NFC
+    bool ingest_repair, ingest_nfc;
+} config_t;
+
+config_t config = {
+    "http://cppblog.io",
+    true, true,
+    600, 86400,
+    60, 60,
+    "", "1:2", "$scheme$host$request_uri$cppblog_encoding",
+    32, false,
+    true, true
+};
+
+bool config_flag(const std::string &value) {
+    return value == "1" || value == "on" || value == "yes" || value == "true";
+}
+
+void config_set(const std::string &key, const std::string &value) {
+    if (key == "domain") {
+        // the URL builders append paths to it as it is
+        config.domain = rtrim_view(value, "/");
+    } else if (key == "minify") {
+        config.minify = config_flag(value);
+    } else if (key == "stream") {
+        config.stream = config_flag(value);
+    } else if (key == "entry_max_age") {
+        config.entry_max_age = atoi(value.c_str());
+    } else if (key == "entry_accel_expires") {
+        config.entry_accel_expires = atoi(value.c_str());
+    } else if (key == "listing_max_age") {
+        config.listing_max_age = atoi(value.c_str());
+    } else if (key == "listing_accel_expires") {
+        config.listing_accel_expires = atoi(value.c_str());
+    } else if (key == "nginx_cache_path") {
+        config.nginx_cache_path = value;
+    } else if (key == "nginx_cache_levels") {
+        config.nginx_cache_levels = value;
+    } else if (key == "nginx_cache_key") {
+        config.nginx_cache_key = value;
+    } else if (key == "entry_cache_mb") {
+        config.entry_cache_mb = atoi(value.c_str());
+    } else if (key == "entry_cache_stats") {
+        config.entry_cache_stats = config_flag(value);
+    } else if (key == "ingest_repair") {
+        config.ingest_repair = config_flag(value);
+    } else if (key == "ingest_nfc") {
+        config.ingest_nfc = config_flag(value);
+    }
+}
+// "key = value" lines, '#' starts a comment. A missing file keeps the
+// defaults. CPPBLOG_MINIFY and CPPBLOG_STREAM in the environment win over
+// the file so nginx can switch them per location with fastcgi_param.
+void load_config(const std::string &file) {
+    FILE *fp = fopen(file.c_str(), "r");
+    if (fp) {
+        char line[1024];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            std::string text(line);
+            text = text.substr(0, text.find('#'));
+            size_t eq = text.find('=');
+            if (eq == std::string::npos) {
+                continue;
+            }
+            std::string key = text.substr(0, eq), value = text.substr(eq + 1);
+            config_set(trim(key), trim(value));
+        }
+        fclose(fp);
+    }
+    const char *env = getenv("CPPBLOG_MINIFY");
+    if (env != NULL) {
+        config.minify = config_flag(env);
+    }
+    env = getenv("CPPBLOG_STREAM");
+    if (env != NULL) {
+        config.stream = config_flag(env);
+    }
+}
+
+#endif
@@ -1,65 +1,304 @@
 #include <iostream>
 #include <string>
 #include <stdlib.h>
-#include <regex>
+#include <vector>
+#include <sstream>
 #include "util.h"
 #include "http.h"
 #include "html.h"
 #include "sqlite3.h"
 #include "dump.h"
+#include "db.h"
+#include "cache.h"
+#include "server.h"
+#include "config.h"
+#include "purge.h"
+#include "search.h"
+#include "archive.h"
+#include "listing.h"
+#include "terms.h"
+#include "entry.h"
+#include "entry_cache.h"
+#include "feed.h"
+#include "sitemap.h"
+#include "amp.h"
+#include "bench.h"
+#include "import.h"
+#include "backup.h"
+#include "profile.h"
 
 std::string current_path = "./";
 std::string dbFile = "cppblog.db";
+std::string cacheDir = "cache";
 sqlite3 *db;
+// only --serve outlives a request, so only it keeps entries and terms
+// around
+entry_cache *entries = NULL;
+term_dictionary *term_dict = NULL;
 
-std::regex make_regex(std::string re, bool ignorecase = false) {
-    if (ignorecase) {
-        return std::regex(re, std::regex_constants::ECMAScript | std::regex_constants::icase);
+enum route_kind_t {
+    ROUTE_NOT_FOUND = 0,
+    ROUTE_REDIRECT,
+    ROUTE_HOME,
+    ROUTE_TAG,
+    ROUTE_CATEGORY,
+    ROUTE_ARCHIVE,
+    ROUTE_AMP,
+    ROUTE_ENTRY,
+    ROUTE_SEARCH,
+    ROUTE_FEED,
+    ROUTE_SITEMAP
+};
+
+typedef struct {
+    route_kind_t kind;
+    // location: where a redirect points, or the listing a feed follows
+    std::string slug, location, cursor;
+    // listings: whether cursor pages towards newer posts
+    bool newer;
+    // entries: the post, found while routing
+    const entry_t *entry;
+} route_t;
+// The post with slug, from the entry cache when there is one; NULL when
+// there is no such post. Valid until the next call.
+const entry_t *find_entry(const std::string &slug) {
+    static entry_t loaded;
+    if (entries == NULL) {
+        loaded = entry_t();
+        return load_entry(db, slug, loaded) ? &loaded : NULL;
+    }
+    const entry_t *entry = entries->get(slug);
+    // for sizing entry_cache_mb; off by default, it goes to nginx's log
+    if (config.entry_cache_stats && (entries->hits + entries->misses) % 1024 == 0) {
+        std::cerr << "entry cache: " << entries->size() << " entries, " << entries->bytes << " bytes, "
+            << entries->hits << " hits, " << entries->misses << " misses, " << entries->evictions << " evictions" << std::endl;
     }
-    return std::regex(re);
+    return entry;
 }
 
-int main(int argc, char **argv) {
-    current_path = getexepath();
-    if ( ! is_dir( current_path + "datas" ) && ! mkdirAll( current_path + "datas" )) {
-        std::cout << "Could not create sqlite quote store data" << std::endl;
-		return 1;
+bool term_exists(const std::string &slug) {
+    if (term_dict != NULL) {
+        return term_dict->lookup(slug) != NULL;
     }
+    return row_exists(db, "SELECT 1 FROM terms WHERE slug = ?;", slug);
+}
+// A path split on '/' with the flag for a trailing slash: "/a/b/" is
+// { "a", "b" } and slash. An empty segment ("//") matches no route.
+typedef struct {
+    std::vector<std::string> segments;
+    bool slash;
+} route_path_t;
 
-    int rc;
-    bool dbinstall = false;
-    dbFile = current_path + "datas" + PATH_SEPARATOR + dbFile;
-    if ( ! file_exists( dbFile ) ) {
-        dbinstall = true;
+bool split_route_path(const std::string &path, route_path_t &parts) {
+    parts.segments.clear();
+    parts.slash = path.size() > 1 && path[path.size() - 1] == '/';
+    size_t start = 1, end = path.size() - (parts.slash ? 1 : 0);
+    while (start <= end) {
+        size_t next = path.find('/', start);
+        if (next == std::string::npos || next > end) {
+            next = end;
+        }
+        if (next == start) {
+            return false;
+        }
+        parts.segments.push_back(path.substr(start, next - start));
+        start = next + 1;
     }
-    rc = sqlite3_open(dbFile.c_str(), &db);
-    if( rc != SQLITE_OK ){
-        std::cout << "DB Error: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_close(db);
-        return 1;
+    return true;
+}
+// digits, exactly count of them unless count is 0
+bool is_number(const std::string &segment, size_t count = 0) {
+    if (segment.empty() || (count > 0 && segment.size() != count)) {
+        return false;
     }
-    if (dbinstall) {
-        char *zErrMsg = 0;
-        rc = sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS posts ( id INTEGER PRIMARY KEY AUTOINCREMENT, title TEXT NOT NULL, slug TEXT NOT NULL, excerpt TEXT NOT NULL, content TEXT NOT NULL, pubdate TEXT NOT NULL, tags TEXT NOT NULL );", NULL, 0, &zErrMsg);
-        if ( rc != SQLITE_OK ) {
-            std::cout << "SQL error create posts table: " << zErrMsg << std::endl;
-            sqlite3_close(db);
-            return 1;
-        }
-        rc = sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS terms ( id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL, slug TEXT NOT NULL );", NULL, 0, &zErrMsg);
-        if ( rc != SQLITE_OK ) {
-            std::cout << "SQL error create terms table: " << zErrMsg << std::endl;
-            sqlite3_close(db);
-            return 1;
+    return segment.find_first_not_of("0123456789") == std::string::npos;
+}
+
+bool is_direction(const std::string &segment) {
+    return strcasecmp(segment.c_str(), "cu-hon") == 0 || strcasecmp(segment.c_str(), "moi-hon") == 0;
+}
+
+bool is_listing_base(const std::string &segment) {
+    return strcasecmp(segment.c_str(), "tu-khoa") == 0 || strcasecmp(segment.c_str(), "chuyen-muc") == 0;
+}
+// Checks that the term or post a path names exists, and sends paths that
+// only lack the trailing slash to their canonical form. Posts are looked
+// up with find_entry so their pages render from the entry.
+route_t matched_route(route_kind_t kind, const std::string &slug, bool slash, const std::string &path) {
+    route_t route = { ROUTE_NOT_FOUND, decode_url(slug), "" };
+    bool is_term = kind == ROUTE_TAG || kind == ROUTE_CATEGORY;
+    if (is_term ? ! term_exists(route.slug) : (route.entry = find_entry(route.slug)) == NULL) {
+        return route;
+    }
+    if ( ! slash) {
+        route.kind = ROUTE_REDIRECT;
+        route.location = path + "/";
+        return route;
+    }
+    route.kind = kind;
+    return route;
+}
+
+// Later pages of a listing: [/tu-khoa/<slug>]/cu-hon/<post id>/ and the
+// same with moi-hon. The term and the post paged from must both exist.
+route_t paged_route(const route_path_t &parts, const std::string &path) {
+    const std::vector<std::string> &seg = parts.segments;
+    bool is_term = seg.size() == 4;
+    route_t route = { ROUTE_NOT_FOUND, is_term ? decode_url(seg[1]) : "", "", seg[seg.size() - 1], false };
+    if (is_term && ! term_exists(route.slug)) {
+        return route;
+    }
+    if ( ! row_exists(db, "SELECT 1 FROM posts WHERE id = ?;", route.cursor)) {
+        return route;
+    }
+    if ( ! parts.slash) {
+        route.kind = ROUTE_REDIRECT;
+        route.location = path + "/";
+        return route;
+    }
+    route.kind = ! is_term ? ROUTE_HOME : (strcasecmp(seg[0].c_str(), "tu-khoa") == 0 ? ROUTE_TAG : ROUTE_CATEGORY);
+    route.newer = strcasecmp(seg[seg.size() - 2].c_str(), "moi-hon") == 0;
+    return route;
+}
+
+// Month archives: /yyyy/mm/ and its later pages, for months with posts.
+route_t archive_route(const route_path_t &parts, const std::string &path) {
+    const std::vector<std::string> &seg = parts.segments;
+    int month = atoi(seg[0].c_str()) * 100 + atoi(seg[1].c_str());
+    route_t route = { ROUTE_NOT_FOUND, std::to_string(month), "", seg.size() == 4 ? seg[3] : "", false };
+    if ( ! row_exists(db, "SELECT 1 FROM archive_months WHERE month = ? AND post_count > 0;", route.slug)) {
+        return route;
+    }
+    if ( ! route.cursor.empty() && ! row_exists(db, "SELECT 1 FROM posts WHERE id = ?;", route.cursor)) {
+        return route;
+    }
+    if ( ! parts.slash) {
+        route.kind = ROUTE_REDIRECT;
+        route.location = path + "/";
+        return route;
+    }
+    route.kind = ROUTE_ARCHIVE;
+    route.newer = seg.size() == 4 && strcasecmp(seg[2].c_str(), "moi-hon") == 0;
+    return route;
+}
+// Feeds: /feed/ and /(tu-khoa|chuyen-muc)/<slug>/feed/, for terms that
+// exist.
+route_t feed_route(const route_path_t &parts, const std::string &path) {
+    const std::vector<std::string> &seg = parts.segments;
+    route_t route = { ROUTE_NOT_FOUND, seg.size() == 3 ? decode_url(seg[1]) : "", "" };
+    if (seg.size() == 3 && ! term_exists(route.slug)) {
+        return route;
+    }
+    if ( ! parts.slash) {
+        route.kind = ROUTE_REDIRECT;
+        route.location = path + "/";
+        return route;
+    }
+    route.kind = ROUTE_FEED;
+    route.location = "/";
+    if (seg.size() == 3) {
+        route.location += strcasecmp(seg[0].c_str(), "tu-khoa") == 0 ? "tu-khoa/" : "chuyen-muc/";
+        encode_url_to(route.slug, route.location);
+        route.location += '/';
+    }
+    return route;
+}
+// The path with the fixed segments of its pattern in lower case, the
+// only form pages are cached, given a cache policy and purged under.
+// Slugs are kept as they are.
+std::string canonical_route_path(const route_path_t &parts) {
+    std::vector<std::string> seg = parts.segments;
+    size_t n = seg.size();
+    for (size_t i = 0; i < n; i++) {
+        bool fixed = (i == 0 && n >= 2 && is_listing_base(seg[i]))
+            || (i == n - 2 && (n == 2 || n == 4) && is_direction(seg[i]))
+            || (i == n - 1 && (n == 1 || n == 3) && strcasecmp(seg[i].c_str(), "feed") == 0)
+            || (i == 1 && n == 2 && strcasecmp(seg[i].c_str(), "amp") == 0);
+        for (size_t j = 0; fixed && j < seg[i].size(); j++) {
+            seg[i][j] = tolower((unsigned char)seg[i][j]);
         }
-        rc = sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS post_terms ( id INTEGER PRIMARY KEY AUTOINCREMENT, post_id INTEGER NOT NULL DEFAULT 0, term_id INTEGER NOT NULL DEFAULT 0 );", NULL, 0, &zErrMsg);
-        if ( rc != SQLITE_OK ) {
-            std::cout << "SQL error create post terms table: " << zErrMsg << std::endl;
-            sqlite3_close(db);
-            return 1;
+    }
+    std::string path;
+    for (size_t i = 0; i < n; i++) {
+        path += '/' + seg[i];
+    }
+    return parts.slash ? path + '/' : path;
+}
+
+route_t segment_route(const route_path_t &parts, const std::string &path) {
+    route_t route = { ROUTE_NOT_FOUND, "", "" };
+    const std::vector<std::string> &seg = parts.segments;
+    size_t n = seg.size();
+    // [/(tu-khoa|chuyen-muc)/<slug>]/(cu-hon|moi-hon)/<id>
+    if ((n == 2 || (n == 4 && is_listing_base(seg[0]))) && is_direction(seg[n - 2]) && is_number(seg[n - 1])) {
+        return paged_route(parts, path);
+    }
+    // /yyyy/mm[/(cu-hon|moi-hon)/<id>]
+    if ((n == 2 || (n == 4 && is_direction(seg[2]) && is_number(seg[3]))) && is_number(seg[0], 4) && is_number(seg[1], 2)) {
+        return archive_route(parts, path);
+    }
+    if ((n == 1 || (n == 3 && is_listing_base(seg[0]))) && strcasecmp(seg[n - 1].c_str(), "feed") == 0) {
+        return feed_route(parts, path);
+    }
+    if (n == 2 && strcasecmp(seg[0].c_str(), "tu-khoa") == 0) {
+        return matched_route(ROUTE_TAG, seg[1], parts.slash, path);
+    }
+    if (n == 2 && strcasecmp(seg[0].c_str(), "chuyen-muc") == 0) {
+        return matched_route(ROUTE_CATEGORY, seg[1], parts.slash, path);
+    }
+    if (n == 2 && strcasecmp(seg[1].c_str(), "amp") == 0) {
+        return matched_route(ROUTE_AMP, seg[0], parts.slash, path);
+    }
+    if (n == 1) {
+        return matched_route(ROUTE_ENTRY, seg[0], parts.slash, path);
+    }
+    return route;
+}
+// Paths are matched segment by segment, in the order the patterns were
+// once tried as regexes; building those regexes took most of a CGI
+// request's routing time. The segments match in any case, and a page
+// reached through a non-canonical case is redirected to its canonical
+// path.
+route_t resolve_route(const std::string &path) {
+    route_t route = { ROUTE_NOT_FOUND, "", "" };
+    if (path == "/") {
+        route.kind = ROUTE_HOME;
+        return route;
+    }
+    long long shard;
+    sitemap_kind_t sitemap = sitemap_kind(path, shard);
+    if (sitemap != SITEMAP_NONE) {
+        // written on a miss, and only for shards that hold rows
+        if (sitemap == SITEMAP_INDEX || sitemap == SITEMAP_PAGES || sitemap_shard_used(db, sitemap, shard)) {
+            route.kind = ROUTE_SITEMAP;
         }
+        return route;
+    }
+    if (path == "/tim-kiem" || path == "/tim-kiem/") {
+        route.kind = ROUTE_SEARCH;
+        route.slug = query_param("q");
+        route.cursor = query_param("after");
+        return route;
+    }
+    route_path_t parts;
+    if (path.empty() || path[0] != '/' || ! split_route_path(path, parts)) {
+        return route;
+    }
+    std::string canonical = canonical_route_path(parts);
+    route = segment_route(parts, canonical);
+    if (route.kind != ROUTE_NOT_FOUND && route.kind != ROUTE_REDIRECT && canonical != path) {
+        route.kind = ROUTE_REDIRECT;
+        route.location = canonical;
+    }
+    return route;
+}
+
+void render_request(const route_t &route) {
+    if (route.kind == ROUTE_AMP) {
+        // a document of its own, styled inline
+        render_amp(*route.entry, current_path + "public");
+        return;
     }
-    set_content_type("text/html; charset=utf-8");
     html_doctype();
     html_begin();
     head_begin();
@@ -67,56 +306,464 @@ int main(int argc, char **argv) {
     meta_viewport();
     title_tag("CPP Blog");
     site_stylesheet("/");
+    if (route.kind == ROUTE_ENTRY) {
+        amp_link(*route.entry);
+    }
     head_end();
+    flush_output();
     body_begin();
     h1_tag("This is CPP Blog");
     p_tag("This is description CPP Blog");
     blockquote_tag("This is simple and the first idea blog on c code, using cgi + sqlite to store database");
-    const char *path_info = getenv("REQUEST_URI");
-    if (path_info != NULL) {
-		if (strcmp(path_info,"/") == 0) {
-			p_tag("That homepage");
-			goto BREAKOUT;
-			return 0;
-		}
-        p_tag("Request URI: " + std::string(path_info));
-        std::regex rx = make_regex("^/tu-khoa/(.+)?/?$", true);
-        std::smatch res;
-        std::string path = std::string(path_info); // https://stackoverflow.com/a/30495370
-        if(std::regex_search(path, res, rx)) {
-            if (res.size() > 1) {
-                p_tag("Tag: " + decode_url(std::string(res[1])));
-                goto BREAKOUT;
-				return 0;
+    switch (route.kind) {
+        case ROUTE_HOME:
+            render_listing(db, "/", "", 0, atoll(route.cursor.c_str()), route.newer);
+            // only here: every post change purges the homepage, while the
+            // term listings are purged just for the post's own terms
+            if (term_dict != NULL) {
+                render_terms(term_dict->by_name(), the_tag_url);
+            } else {
+                render_terms(db, the_tag_url);
             }
+            render_months(db);
+            break;
+        case ROUTE_TAG:
+            h2_tag("Tag: " + htmlspecialchars(route.slug));
+            render_listing(db, "/tu-khoa/" + encode_url(route.slug) + "/", route.slug, 0, atoll(route.cursor.c_str()), route.newer);
+            break;
+        case ROUTE_CATEGORY:
+            h2_tag("Category: " + htmlspecialchars(route.slug));
+            render_listing(db, "/chuyen-muc/" + encode_url(route.slug) + "/", route.slug, 0, atoll(route.cursor.c_str()), route.newer);
+            break;
+        case ROUTE_ARCHIVE: {
+            int month = atoi(route.slug.c_str());
+            h2_tag("Archive: " + archive_label(month));
+            render_listing(db, archive_url(month), "", month, atoll(route.cursor.c_str()), route.newer);
+            break;
         }
-        rx = make_regex("^/chuyen-muc/(.+)?/?$", true);
-        if(std::regex_search(path, res, rx)) {
-            if (res.size() > 1) {
-                p_tag("Category: " + decode_url(std::string(res[1])));
-                goto BREAKOUT;
-				return 0;
-            }
+        case ROUTE_ENTRY:
+            render_entry(*route.entry);
+            break;
+        case ROUTE_SEARCH:
+            render_search(db, route.slug, route.cursor);
+            break;
+        default:
+            p_tag("Not found");
+            break;
+    }
+    body_end();
+    html_end();
+}
+// Renders a page into a string instead of stdout so it can be compressed
+// and stored before it is sent.
+std::string render_page(const route_t &route) {
+    std::stringstream out;
+    std::streambuf *old = std::cout.rdbuf(out.rdbuf());
+    render_request(route);
+    std::cout.rdbuf(old);
+    return out.str();
+}
+
+std::vector<std::string> site_urls() {
+    std::vector<std::string> urls;
+    urls.push_back("/");
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT slug FROM posts ORDER BY id;", -1, &stmt, NULL) != SQLITE_OK) {
+        return urls;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        std::string url = "/" + std::string((const char*)sqlite3_column_text(stmt, 0)) + "/";
+        urls.push_back(url);
+        urls.push_back(url + "amp/");
+    }
+    sqlite3_finalize(stmt);
+    return urls;
+}
+// Static build: renders every known URL once into root with its gzip and
+// brotli variants, ready for nginx gzip_static/brotli_static.
+bool build_site(const std::string &root) {
+    std::vector<std::string> urls = site_urls();
+    size_t bytes = 0, stored = 0;
+    for (auto url = urls.begin(); url != urls.end(); ++url) {
+        page_variants_t page;
+        route_t route = resolve_route(*url);
+        if (route.kind == ROUTE_NOT_FOUND || route.kind == ROUTE_REDIRECT) {
+            continue;
         }
-        rx = make_regex("^/(.+)/amp?/?$", true);
-        if(std::regex_search(path, res, rx)) {
-            if (res.size() > 1) {
-                p_tag("Entry AMP: " + decode_url(std::string(res[1])));
-                goto BREAKOUT;
-				return 0;
-            }
+        page.identity = render_page(route);
+        if ( ! page_fill(page, config.minify) || ! page_store(root, *url, page)) {
+            std::cout << "Could not store " << *url << " in " << root << std::endl;
+            return false;
         }
-        rx = make_regex("^/(.+)?/?$", true);
-        if(std::regex_search(path, res, rx)) {
-            if (res.size() > 1) {
-                p_tag("Entry: " + decode_url(std::string(res[1])));
-                goto BREAKOUT;
-				return 0;
+        bytes += page.identity.size();
+        stored += page.brotli.empty() ? page.gzip.size() : page.brotli.size();
+    }
+    std::cout << "Built " << urls.size() << " pages: " << bytes << " bytes, " << stored << " bytes compressed" << std::endl;
+    if ( ! write_sitemap(db, root, "/sitemap.xml", true)) {
+        std::cout << "Could not store the sitemaps in " << root << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Browsers may keep entries a while; nginx may keep them much longer since
+// writes purge it. Listings and search results change with every post and
+// are kept briefly.
+void set_cache_policy(const std::string &path) {
+    bool listing = path == "/" || path == "/tim-kiem" || path == "/tim-kiem/" || path.compare(0, 9, "/tu-khoa/") == 0 || path.compare(0, 12, "/chuyen-muc/") == 0
+        || path.compare(0, 8, "/cu-hon/") == 0 || path.compare(0, 9, "/moi-hon/") == 0 || is_archive_path(path) || is_feed_path(path)
+        || is_sitemap_path(path);
+    int max_age = listing ? config.listing_max_age : config.entry_max_age;
+    int accel_expires = listing ? config.listing_accel_expires : config.entry_accel_expires;
+    set_header("Cache-Control", "public, max-age=" + std::to_string(max_age));
+    set_header("X-Accel-Expires", std::to_string(accel_expires));
+}
+
+// Search results and later listing pages are left to nginx's short-lived
+// cache: purging a post could not find every page it has slid onto.
+bool route_storable(const route_t &route) {
+    return route.kind != ROUTE_SEARCH && route.cursor.empty();
+}
+
+void set_profile_header() {
+    if (profile_enabled) {
+        set_header("Server-Timing", profile_server_timing());
+    }
+}
+
+// Feeds carry validators, so a poller's conditional GET of a stored feed
+// is answered from a stat() alone. Sets ETag and Last-Modified when the
+// feed is stored; coding is updated to the variant they describe.
+bool feed_not_modified(const std::string &path, content_coding_t &coding) {
+    std::string etag;
+    time_t modified;
+    return page_validators(cacheDir, path, coding, etag, modified) && not_modified(etag, modified);
+}
+
+sqlite3 *open_database(db_role_t role) {
+    sqlite3 *conn = db_open(dbFile, role);
+    // a reader failing is expected before the first run created the file
+    if (conn == NULL && role == DB_READER) {
+        return NULL;
+    }
+    if (conn == NULL) {
+        std::cout << "DB Error: could not open " << dbFile << std::endl;
+        return NULL;
+    }
+    profile_mark("sqlite_open");
+    if ( ! register_search_tokenizer(conn)) {
+        std::cout << "DB Error: FTS5 is not available" << std::endl;
+        sqlite3_close(conn);
+        return NULL;
+    }
+    return conn;
+}
+// Opens the database for a request or a command: read-only to serve,
+// the writer for the commands that change data. A current stamp lets a
+// reader skip the directory and schema checks; otherwise the writer
+// migrates first.
+bool setup_database(bool writes) {
+    if ( ! writes && db_stamp_current(dbFile) && (db = open_database(DB_READER)) != NULL) {
+        profile_mark("open");
+        return true;
+    }
+    if ( ! is_dir( current_path + "datas" ) && ! mkdirAll( current_path + "datas" )) {
+        std::cout << "Could not create sqlite quote store data" << std::endl;
+        return false;
+    }
+    profile_mark("datas");
+    db = writes ? NULL : open_database(DB_READER);
+    if (db == NULL || ! db_ready(db)) {
+        sqlite3_close(db);
+        db = open_database(DB_WRITER);
+        if (db == NULL || ! db_migrate(db)) {
+            sqlite3_close(db);
+            db = NULL;
+            return false;
+        }
+        if ( ! writes) {
+            db_checkpoint(db);
+            sqlite3_close(db);
+            if ((db = open_database(DB_READER)) == NULL) {
+                std::cout << "DB Error: could not open " << dbFile << " read-only" << std::endl;
+                return false;
             }
         }
     }
-BREAKOUT:
-    body_end();
-    html_end();
+    db_write_stamp(dbFile);
+    profile_mark("schema");
+    return true;
+}
+
+int handle_request() {
+    reset_response();
+    const char *request_uri = getenv("REQUEST_URI");
+    std::string path = request_uri != NULL ? std::string(request_uri) : "/";
+    size_t query = path.find('?');
+    path = path.substr(0, query);
+    bool feed = is_feed_path(path);
+    set_content_type(feed ? feed_content_type : is_sitemap_path(path) ? "application/xml; charset=utf-8" : "text/html; charset=utf-8");
+    set_cache_policy(path);
+    content_coding_t coding = negotiate_coding(getenv("HTTP_ACCEPT_ENCODING"));
+    if (feed && feed_not_modified(path, coding)) {
+        profile_mark("page_cache");
+        set_profile_header();
+        send_not_modified();
+        return 0;
+    }
+    std::string body;
+    bool cached = page_load(cacheDir, path, coding, body);
+    profile_mark("page_cache");
+    if (cached) {
+        set_profile_header();
+        send_encoded(body, coding);
+        return 0;
+    }
+    if (db == NULL && ! setup_database(false)) {
+        set_status(500);
+        send_response("");
+        return 1;
+    }
+    // whatever another process wrote since the last request
+    if (entries != NULL) {
+        entries->refresh();
+    }
+    if (term_dict != NULL) {
+        term_dict->refresh();
+    }
+    // the route is resolved before any output so the status is known
+    // when the head is flushed
+    route_t route = resolve_route(path);
+    profile_mark("route");
+    set_profile_header();
+    if (route.kind == ROUTE_REDIRECT) {
+        std::string location = route.location;
+        if (query != std::string::npos) {
+            location += std::string(request_uri).substr(query);
+        }
+        // where a redirect points can vanish with the post it names, and
+        // no write purges it
+        set_header("Cache-Control", "public, max-age=60");
+        set_header("X-Accel-Expires", "10");
+        redirect(location);
+        send_response("");
+        return 0;
+    }
+    if (route.kind == ROUTE_NOT_FOUND) {
+        set_content_type("text/html; charset=utf-8");
+        set_status(404);
+        set_header("Cache-Control", "public, max-age=60");
+        set_header("X-Accel-Expires", "10");
+        send_response(render_page(route));
+        return 0;
+    }
+    if (route.kind == ROUTE_FEED) {
+        page_variants_t page;
+        if ( ! render_feed(db, route.slug, route.location, page.identity)) {
+            set_status(500);
+            send_response("");
+            return 1;
+        }
+        // stored before it is sent, so the validators describe the file
+        // later polls are checked against
+        if (page_compress(page) && page_store(cacheDir, path, page)) {
+            content_coding_t stored = coding;
+            feed_not_modified(path, stored);
+        }
+        send_encoded(page_variant(page, coding), coding);
+        return 0;
+    }
+    if (route.kind == ROUTE_SITEMAP) {
+        // streamed to its file, then sent from there like a hit
+        if ( ! write_sitemap(db, cacheDir, path) || ! page_load(cacheDir, path, coding, body)) {
+            set_status(500);
+            send_response("");
+            return 1;
+        }
+        send_encoded(body, coding);
+        return 0;
+    }
+    if (is_head_request()) {
+        send_response(render_page(route));
+        return 0;
+    }
+    if ( ! config.stream) {
+        // behind fastcgi_cache nginx buffers anyway; send the compressed
+        // variant with its length so the cached copy is the small one
+        page_variants_t page;
+        page.identity = render_page(route);
+        if (page_fill(page, config.minify) && route_storable(route)) {
+            page_store(cacheDir, path, page);
+        }
+        send_encoded(page_variant(page, coding), coding);
+        return 0;
+    }
+    // a miss is streamed, so the <head> leaves before the body is rendered,
+    // and the copy kept on the way fills the cache for the next hit
+    page_variants_t page;
+    begin_stream();
+    tee_buf tee(std::cout.rdbuf(), page.identity);
+    std::streambuf *old = std::cout.rdbuf(&tee);
+    render_request(route);
+    std::cout.rdbuf(old);
+    std::cout.flush();
+    if (route_storable(route) && page_fill(page, config.minify)) {
+        page_store(cacheDir, path, page);
+    }
     return 0;
 }
+
+// Restores into a new file next to the database and renames it over the
+// database only once the restore succeeded. Run it while nothing serves
+// from the database: its -wal and -shm files are dropped with it, and the
+// cached pages still show the old data.
+bool restore_database(const std::string &dump) {
+    std::string file = dbFile + ".restore";
+    remove(file.c_str());
+    sqlite3 *conn = NULL;
+    if (sqlite3_open(file.c_str(), &conn) != SQLITE_OK || ! register_search_tokenizer(conn)) {
+        std::cout << "DB Error: could not create " << file << std::endl;
+        sqlite3_close(conn);
+        return false;
+    }
+    bool ok = restore_db(conn, dump);
+    ok = sqlite3_close(conn) == SQLITE_OK && ok;
+    if ( ! ok) {
+        remove(file.c_str());
+        return false;
+    }
+    remove((dbFile + "-wal").c_str());
+    remove((dbFile + "-shm").c_str());
+    remove(db_stamp_file(dbFile).c_str());
+    return rename(file.c_str(), dbFile.c_str()) == 0;
+}
+
+int main(int argc, char **argv) {
+    profile_enabled = argc == 1 && getenv("CPPBLOG_PROFILE") != NULL;
+    profile_mark("static_init");
+    current_path = getexepath();
+    dbFile = current_path + "datas" + PATH_SEPARATOR + dbFile;
+    cacheDir = current_path + "datas" + PATH_SEPARATOR + cacheDir;
+    profile_mark("exepath");
+    load_config(current_path + "cppblog.ini");
+    profile_mark("config");
+    // a CGI request: pages in the page cache are sent without opening
+    // the database, which handle_request() does on a miss
+    if (argc == 1) {
+        int status = handle_request();
+        profile_report(getenv("REQUEST_URI"));
+        return status;
+    }
+    if (argc > 2 && strcmp(argv[1], "--restore") == 0) {
+        if ( ! is_dir( current_path + "datas" ) && ! mkdirAll( current_path + "datas" )) {
+            std::cout << "Could not create sqlite quote store data" << std::endl;
+            return 1;
+        }
+        return restore_database(argv[2]) ? 0 : 1;
+    }
+    // benchmarks work on scratch databases or in memory; they run before
+    // the site's database is opened, so they never migrate it
+    if (strncmp(argv[1], "--bench-", 8) == 0) {
+        if ( ! is_dir( current_path + "datas" ) && ! mkdirAll( current_path + "datas" )) {
+            std::cout << "Could not create sqlite quote store data" << std::endl;
+            return 1;
+        }
+        if (argc > 2 && strcmp(argv[1], "--bench-reads") == 0) {
+            bool tuned = argc < 4 || strcmp(argv[3], "rollback") != 0;
+            return bench_reads(current_path + "datas" + PATH_SEPARATOR + "bench-reads.db", atoi(argv[2]) > 0 ? atoi(argv[2]) : 5, tuned) ? 0 : 1;
+        }
+        if (argc > 1 && strcmp(argv[1], "--bench-terms") == 0) {
+            int count = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 1000, rounds = argc > 3 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 100;
+            return bench_terms(count, rounds) ? 0 : 1;
+        }
+        if (argc > 1 && strcmp(argv[1], "--bench-urls") == 0) {
+            int count = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 1000, rounds = argc > 3 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 1000;
+            return bench_urls(count, rounds) ? 0 : 1;
+        }
+        if (argc > 1 && strcmp(argv[1], "--bench-links") == 0) {
+            int posts = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 100, terms = argc > 3 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 6;
+            return bench_links(current_path + "datas" + PATH_SEPARATOR + "bench-links.db", posts, terms, argc > 4 && atoi(argv[4]) > 0 ? atoi(argv[4]) : 10000) ? 0 : 1;
+        }
+        if (argc > 1 && strcmp(argv[1], "--bench-slugs") == 0) {
+            int titles = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 10000, rounds = argc > 3 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 100;
+            return bench_slugs(titles, rounds) ? 0 : 1;
+        }
+        if (argc > 1 && strcmp(argv[1], "--bench-utf8") == 0) {
+            int megabytes = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 16, rounds = argc > 3 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 5;
+            return bench_utf8(megabytes, rounds) ? 0 : 1;
+        }
+        if (argc > 1 && strcmp(argv[1], "--bench-dump") == 0) {
+            int posts = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 10000, jobs = argc > 3 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 1;
+            return bench_dump(current_path + "datas" + PATH_SEPARATOR + "bench-dump.db", posts, jobs) ? 0 : 1;
+        }
+        std::cout << "Unknown benchmark " << argv[1] << std::endl;
+        return 1;
+    }
+    // requests are served from a read-only connection; the writer is only
+    // opened to migrate or for the commands that change data
+    bool writes = strcmp(argv[1], "--reindex") == 0 || strcmp(argv[1], "--import") == 0;
+    if ( ! setup_database(writes)) {
+        return 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--build") == 0) {
+        return build_site(argv[2]) ? 0 : 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--serve") == 0) {
+        if (config.entry_cache_mb > 0) {
+            entries = new entry_cache(db, (size_t)config.entry_cache_mb << 20);
+        }
+        term_dict = new term_dictionary(db);
+        return serve(atoi(argv[2]), handle_request);
+    }
+    if (argc > 1 && strcmp(argv[1], "--reindex") == 0) {
+        return reindex_posts(db) && db_checkpoint(db) ? 0 : 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--import") == 0) {
+        std::vector<std::string> terms, urls;
+        long long last_post = sitemap_max_id(db, "posts");
+        // what the committed batches changed is purged even when a later
+        // batch failed
+        bool imported = import_posts(db, argv[2], terms, urls);
+        db_checkpoint(db);
+        std::vector<std::string> sitemaps = sitemap_urls(db, last_post, terms);
+        urls.insert(urls.end(), sitemaps.begin(), sitemaps.end());
+        urls.push_back("/");
+        urls.push_back("/feed/");
+        for (auto term = terms.begin(); term != terms.end(); ++term) {
+            std::vector<std::string> listing = term_urls(*term);
+            urls.insert(urls.end(), listing.begin(), listing.end());
+        }
+        purge_urls(urls, cacheDir);
+        // the sitemaps are rewritten now rather than by a crawler's request
+        return write_sitemap(db, cacheDir, "/sitemap.xml") && imported ? 0 : 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--dump") == 0) {
+        int jobs = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+        double start = now_ms();
+        if ( ! dump_db(dbFile, argv[2], jobs)) {
+            std::cout << "Could not dump " << dbFile << " to " << argv[2] << std::endl;
+            return 1;
+        }
+        struct stat st;
+        std::cout << "Dumped " << (stat(argv[2], &st) == 0 ? (long long)st.st_size : 0) << " bytes in " << now_ms() - start << " ms" << std::endl;
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--backup") == 0) {
+        int pages = argc > 3 ? atoi(argv[3]) : 256, sleep_ms = argc > 4 ? atoi(argv[4]) : 10;
+        return backup_db(db, argv[2], pages != 0 ? pages : 256, sleep_ms) ? 0 : 1;
+    }
+    if (argc > 2 && strcmp(argv[1], "--purge") == 0) {
+        std::vector<std::string> urls(argv + 2, argv + argc);
+        std::cout << "Purged " << purge_urls(urls, cacheDir) << " nginx cache entries" << std::endl;
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--purge-post") == 0) {
+        std::cout << "Purged " << purge_urls(post_urls(db, argv[2]), cacheDir) << " nginx cache entries" << std::endl;
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--purge-term") == 0) {
+        std::cout << "Purged " << purge_urls(term_urls(argv[2]), cacheDir) << " nginx cache entries" << std::endl;
+        return 0;
+    }
+    return handle_request();
+}
@@ -4,100 +4,386 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
 #include "sqlite3.h"
+#include "db.h"
+#include "util.h"
 
-bool dump_db (sqlite3 *db, const char *filename) {
-    FILE *fp = NULL;
-    sqlite3_stmt *stmt_table = NULL;
-    sqlite3_stmt *stmt_data = NULL;
-    const char *table_name = NULL;
-    const char *data = NULL;
-    int col_cnt = 0;
+/* Writes "name" as a quoted SQL identifier. */
+void dump_identifier (FILE *fp, const char *name) {
+    fputc ('"', fp);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"') {
+            fputc ('"', fp);
+        }
+        fputc (*p, fp);
+    }
+    fputc ('"', fp);
+}
+/* Writes column i of the current row as an SQL literal, straight into
+   fp: text is quoted with embedded quotes doubled, blobs become X'..'
+   and reals keep enough digits to read back the same double. */
+void dump_value (FILE *fp, sqlite3_stmt *stmt, int i) {
+    static const char hex[] = "0123456789abcdef";
+    char buff[64];
+    switch (sqlite3_column_type (stmt, i)) {
+        case SQLITE_INTEGER:
+            fprintf (fp, "%lld", (long long)sqlite3_column_int64 (stmt, i));
+            break;
+        case SQLITE_FLOAT: {
+            double v = sqlite3_column_double (stmt, i);
+            if (isinf (v)) {
+                fputs (v < 0 ? "-1e999" : "1e999", fp);
+            } else {
+                /* '!' keeps the decimal point, so 1.0 stays a REAL */
+                sqlite3_snprintf (sizeof (buff), buff, "%!.17g", v);
+                fputs (buff, fp);
+            }
+            break;
+        }
+        case SQLITE_TEXT: {
+            const char *text = (const char*)sqlite3_column_text (stmt, i);
+            const char *end = text + sqlite3_column_bytes (stmt, i);
+            fputc ('\'', fp);
+            while (text < end) {
+                const char *quote = (const char*)memchr (text, '\'', end - text);
+                if (quote == NULL) {
+                    fwrite (text, 1, end - text, fp);
+                    break;
+                }
+                fwrite (text, 1, quote - text + 1, fp);
+                fputc ('\'', fp);
+                text = quote + 1;
+            }
+            fputc ('\'', fp);
+            break;
+        }
+        case SQLITE_BLOB: {
+            const unsigned char *blob = (const unsigned char*)sqlite3_column_blob (stmt, i);
+            int n = sqlite3_column_bytes (stmt, i);
+            fputs ("X'", fp);
+            for (int j = 0; j < n; j++) {
+                fputc (hex[blob[j] >> 4], fp);
+                fputc (hex[blob[j] & 15], fp);
+            }
+            fputc ('\'', fp);
+            break;
+        }
+        default:
+            fputs ("NULL", fp);
+            break;
+    }
+}
+/* INSERT statements for every row of table, one row at a time. */
+bool dump_rows (sqlite3 *db, FILE *fp, const std::string &table) {
+    sqlite3_stmt *stmt = NULL;
+    std::string sql = "SELECT * FROM \"";
+    for (size_t i = 0; i < table.size(); i++) {
+        sql += table[i] == '"' ? "\"\"" : std::string (1, table[i]);
+    }
+    sql += "\";";
+    if (sqlite3_prepare_v2 (db, sql.c_str (), -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    int cols = sqlite3_column_count (stmt), ret;
+    while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+        fputs ("INSERT INTO ", fp);
+        dump_identifier (fp, table.c_str ());
+        fputs (" VALUES(", fp);
+        for (int i = 0; i < cols; i++) {
+            if (i) {
+                fputc (',', fp);
+            }
+            dump_value (fp, stmt, i);
+        }
+        fputs (");\n", fp);
+    }
+    sqlite3_finalize (stmt);
+    return ret == SQLITE_DONE && ! ferror (fp);
+}
+/* sql of every schema object of a type, in creation order. Tables leave
+   out sqlite_sequence and the shadow tables of virtual tables, which the
+   CREATE VIRTUAL TABLE statement makes again. */
+bool dump_schema (sqlite3 *db, const char *type, std::vector<std::string> &names, std::vector<std::string> &sqls) {
+    sqlite3_stmt *stmt = NULL;
+    const char *sql = "SELECT name, sql FROM sqlite_master s WHERE type = ?1 AND sql IS NOT NULL AND name NOT LIKE 'sqlite_%'"
+        " AND (s.type <> 'table' OR NOT EXISTS (SELECT 1 FROM sqlite_master v WHERE v.type = 'table' AND v.sql LIKE 'CREATE VIRTUAL TABLE%'"
+        " AND substr(s.name, 1, length(v.name) + 1) = v.name || '_')) ORDER BY rowid;";
+    if (sqlite3_prepare_v2 (db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text (stmt, 1, type, -1, SQLITE_STATIC);
+    while (sqlite3_step (stmt) == SQLITE_ROW) {
+        names.push_back ((const char*)sqlite3_column_text (stmt, 0));
+        sqls.push_back ((const char*)sqlite3_column_text (stmt, 1));
+    }
+    return sqlite3_finalize (stmt) == SQLITE_OK;
+}
 
-    int ret = SQLITE_OK;
-    int index = 0;
-    char cmd[4096] = {0};
+/* The options an FTS5 table keeps in its _config shadow table, such as
+   its rank function, as the INSERT statements that set them. The
+   shadow table itself is not dumped, and a rebuild leaves it alone, so
+   without these a restore would fall back to the default options. */
+bool dump_fts5_config (sqlite3 *db, FILE *fp, const std::string &table) {
+    sqlite3_stmt *stmt = NULL;
+    std::string sql = "SELECT k, v FROM \"";
+    for (size_t i = 0; i < table.size(); i++) {
+        sql += table[i] == '"' ? "\"\"" : std::string (1, table[i]);
+    }
+    sql += "_config\" WHERE k <> 'version';";
+    if (sqlite3_prepare_v2 (db, sql.c_str (), -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    int ret;
+    while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+        fputs ("INSERT INTO ", fp);
+        dump_identifier (fp, table.c_str ());
+        fputc ('(', fp);
+        dump_identifier (fp, table.c_str ());
+        fputs (", rank) VALUES(", fp);
+        dump_value (fp, stmt, 0);
+        fputc (',', fp);
+        dump_value (fp, stmt, 1);
+        fputs (");\n", fp);
+    }
+    sqlite3_finalize (stmt);
+    return ret == SQLITE_DONE && ! ferror (fp);
+}
 
-    fp = fopen (filename, "w");
+bool append_file (FILE *to, const std::string &from) {
+    FILE *fp = fopen (from.c_str (), "rb");
     if (!fp) {
         return false;
     }
-    ret = sqlite3_prepare_v2 (db, "SELECT sql,tbl_name FROM sqlite_master WHERE type = 'table';", -1, &stmt_table, NULL);
-    if (ret != SQLITE_OK) {
-        goto EXIT;
+    char buff[65536];
+    size_t n;
+    while ((n = fread (buff, 1, sizeof (buff), fp)) > 0) {
+        fwrite (buff, 1, n, to);
     }
-    fprintf (fp, "PRAGMA foreign_keys=OFF;\nBEGIN TRANSACTION;\n");
-    ret = sqlite3_step (stmt_table);
-    while (ret == SQLITE_ROW) {
-        data = (const char*)sqlite3_column_text (stmt_table, 0);
-        table_name = (const char*)sqlite3_column_text (stmt_table, 1);
-        if (!data || !table_name) {
-            ret = -1;
-            goto EXIT;
-        }
-        /* CREATE TABLE statements */
-        fprintf (fp, "%s;\n", data);
-        /* fetch table data */
-        sprintf (cmd, "SELECT * from %s;",table_name);
+    bool ok = ! ferror (fp) && ! ferror (to);
+    fclose (fp);
+    return ok;
+}
+/* Starts a read transaction on each connection such that they all see the
+   same snapshot: while one connection holds the write lock nothing can
+   commit, so every read started meanwhile sees the same data. Writers are
+   held up only for as long as it takes to start the reads. */
+bool dump_snapshot (const std::string &dbfile, std::vector<sqlite3*> &conns) {
+    sqlite3 *lock = conns.size () > 1 ? db_open (dbfile, DB_WRITER) : NULL;
+    bool ok = conns.size () == 1 || (lock != NULL && db_exec (lock, "BEGIN IMMEDIATE;"));
+    for (size_t i = 0; ok && i < conns.size (); i++) {
+        ok = db_exec (conns[i], "BEGIN; SELECT count(*) FROM sqlite_master;");
+    }
+    if (lock != NULL) {
+        db_exec (lock, "ROLLBACK;");
+        sqlite3_close (lock);
+    }
+    return ok;
+}
+/* Writes the database as SQL to filename. Memory use does not depend on
+   the size of the database: every value goes straight to a buffered
+   FILE. With jobs > 1 the tables are dumped in parallel, each on its own
+   read-only connection and into its own part file, all from the same
+   snapshot; the parts are then joined in schema order.
+
+   Data comes before indexes and triggers, so a restore neither updates
+   indexes row by row nor fires triggers on rows that already carry their
+   derived values. FTS5 tables get their options back and are rebuilt from
+   their content table. */
+bool dump_db (const std::string &dbfile, const std::string &filename, int jobs = 1) {
+    std::vector<std::string> tables, table_sql, vtables, vtable_sql, indexes, index_sql, triggers, trigger_sql, names, sqls;
+    std::vector<sqlite3*> conns;
+    FILE *fp = NULL;
+    bool ok = false;
+    int version = 0;
+    std::atomic<size_t> next (0);
+    std::vector<std::thread> threads;
+    std::vector<int> failed;
 
-        ret = sqlite3_prepare_v2 (db, cmd, -1, &stmt_data, NULL);
-        if (ret != SQLITE_OK) {
+    for (int i = 0; i < (jobs > 0 ? jobs : 1); i++) {
+        sqlite3 *conn = db_open (dbfile, DB_READER);
+        if (conn == NULL) {
             goto EXIT;
         }
-        ret = sqlite3_step (stmt_data);
-        while (ret == SQLITE_ROW) {
-            sprintf (cmd, "INSERT INTO \"%s\" VALUES(",table_name);
-            col_cnt = sqlite3_column_count(stmt_data);
-            for (index = 0; index < col_cnt; index++) {
-                if (index) {
-                    strcat (cmd,",");
-                }
-                data = (const char*)sqlite3_column_text (stmt_data, index);
-                if (data) {
-                    if (sqlite3_column_type(stmt_data, index) == SQLITE_TEXT) {
-                        strcat (cmd, "'");
-                        strcat (cmd, data);
-                        strcat (cmd, "'");
-                    } else {
-                        strcat (cmd, data);
+        conns.push_back (conn);
+    }
+    if ( ! dump_snapshot (dbfile, conns)) {
+        goto EXIT;
+    }
+    if ( ! dump_schema (conns[0], "table", names, sqls) || ! dump_schema (conns[0], "index", indexes, index_sql)
+            || ! dump_schema (conns[0], "trigger", triggers, trigger_sql)) {
+        goto EXIT;
+    }
+    for (size_t i = 0; i < names.size (); i++) {
+        bool is_virtual = sqls[i].compare (0, 20, "CREATE VIRTUAL TABLE") == 0;
+        (is_virtual ? vtables : tables).push_back (names[i]);
+        (is_virtual ? vtable_sql : table_sql).push_back (sqls[i]);
+    }
+    version = db_user_version (conns[0]);
+    fp = fopen (filename.c_str (), "w");
+    if (!fp) {
+        goto EXIT;
+    }
+    setvbuf (fp, NULL, _IOFBF, 1 << 20);
+    fprintf (fp, "PRAGMA foreign_keys=OFF;\nBEGIN TRANSACTION;\nPRAGMA user_version=%d;\n", version);
+    for (size_t i = 0; i < names.size (); i++) {
+        fprintf (fp, "%s;\n", sqls[i].c_str ());
+    }
+    if (conns.size () == 1) {
+        for (size_t i = 0; i < tables.size (); i++) {
+            if ( ! dump_rows (conns[0], fp, tables[i])) {
+                goto EXIT;
+            }
+        }
+    } else {
+        failed.assign (tables.size (), 0);
+        for (size_t t = 0; t < conns.size (); t++) {
+            threads.push_back (std::thread ([&, t] () {
+                for (size_t i; (i = next++) < tables.size ();) {
+                    FILE *part = fopen ((filename + ".part" + std::to_string (i)).c_str (), "w");
+                    if (!part) {
+                        failed[i] = 1;
+                        continue;
                     }
-                } else {
-                    strcat (cmd, "NULL");
+                    setvbuf (part, NULL, _IOFBF, 1 << 20);
+                    failed[i] = ! dump_rows (conns[t], part, tables[i]);
+                    failed[i] = (fclose (part) != 0) || failed[i];
                 }
+            }));
+        }
+        for (size_t t = 0; t < threads.size (); t++) {
+            threads[t].join ();
+        }
+        for (size_t i = 0; i < tables.size (); i++) {
+            std::string part = filename + ".part" + std::to_string (i);
+            if (failed[i] || ! append_file (fp, part)) {
+                failed[i] = 1;
+            }
+            remove (part.c_str ());
+        }
+        for (size_t i = 0; i < tables.size (); i++) {
+            if (failed[i]) {
+                goto EXIT;
             }
-            fprintf (fp, "%s);\n", cmd);
-            ret = sqlite3_step (stmt_data);
         }
-        ret = sqlite3_step (stmt_table);
     }
-    /* Triggers */
-    if (stmt_table) {
-        sqlite3_finalize (stmt_table);
+    /* AUTOINCREMENT counters, which the inserts above do not restore */
+    if (row_exists (conns[0], "SELECT 1 FROM sqlite_master WHERE name = ?;", "sqlite_sequence")) {
+        fputs ("DELETE FROM sqlite_sequence;\n", fp);
+        if ( ! dump_rows (conns[0], fp, "sqlite_sequence")) {
+            goto EXIT;
+        }
     }
-    ret = sqlite3_prepare_v2 (db, "SELECT sql FROM sqlite_master WHERE type = 'trigger';", -1, &stmt_table, NULL);
-    if (ret != SQLITE_OK) {
-        goto EXIT;
+    for (size_t i = 0; i < index_sql.size (); i++) {
+        fprintf (fp, "%s;\n", index_sql[i].c_str ());
     }
-    ret = sqlite3_step (stmt_table);
-    while (ret == SQLITE_ROW) {
-        data = (const char*)sqlite3_column_text (stmt_table, 0);
-        if (!data) {
-            ret = -1;
-            goto EXIT;
+    for (size_t i = 0; i < vtables.size (); i++) {
+        if (strcasestr (vtable_sql[i].c_str (), "using fts5") != NULL) {
+            if ( ! dump_fts5_config (conns[0], fp, vtables[i])) {
+                goto EXIT;
+            }
+            fputs ("INSERT INTO ", fp);
+            dump_identifier (fp, vtables[i].c_str ());
+            fputc ('(', fp);
+            dump_identifier (fp, vtables[i].c_str ());
+            fputs (") VALUES('rebuild');\n", fp);
         }
-        /* CREATE TABLE statements */
-        fprintf (fp, "%s;\n", data);
-        ret = sqlite3_step (stmt_table);
     }
-    fprintf (fp, "COMMIT;\n");
+    for (size_t i = 0; i < trigger_sql.size (); i++) {
+        fprintf (fp, "%s;\n", trigger_sql[i].c_str ());
+    }
+    fputs ("COMMIT;\n", fp);
+    ok = ! ferror (fp);
 EXIT:
-    if (stmt_data)
-        sqlite3_finalize (stmt_data);
-    if (stmt_table)
-        sqlite3_finalize (stmt_table);
-    if (fp)
-        fclose (fp);
-    return ret != SQLITE_OK;
+    for (size_t i = 0; i < conns.size (); i++) {
+        sqlite3_close (conns[i]);
+    }
+    if (fp) {
+        ok = (fclose (fp) == 0) && ok;
+    }
+    return ok;
+}
+
+/* Whether sql, a statement as read from a dump, starts with keyword. */
+bool dump_statement_is (const std::string &sql, const char *keyword) {
+    size_t i = sql.find_first_not_of (" \t\r\n");
+    return i != std::string::npos && strncasecmp (sql.c_str () + i, keyword, strlen (keyword)) == 0;
+}
+/* Loads a dump written by dump_db (or the sqlite3 shell's .dump) into db,
+   which should be a new, empty database. The file is read a line at a
+   time and each statement runs as soon as it is complete, so memory use
+   does not depend on the size of the dump.
+
+   Everything runs in one transaction, without a journal and without
+   syncing: a failed restore leaves a file fit only for deleting. The
+   dump's own BEGIN and COMMIT are skipped and its indexes are created
+   after all the rows are in, then ANALYZE gives the planner statistics
+   for them. The connection is switched to WAL at the end. */
+bool restore_db (sqlite3 *db, const std::string &filename) {
+    FILE *fp = fopen (filename.c_str (), "r");
+    if (!fp) {
+        printf ("Could not open %s\n", filename.c_str ());
+        return false;
+    }
+    setvbuf (fp, NULL, _IOFBF, 1 << 20);
+    std::vector<std::string> indexes;
+    std::string sql;
+    char *line = NULL, *error = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    long line_no = 0, statement_line = 0, statements = 0;
+    double start = now_ms (), loaded = 0, indexed = 0;
+    bool ok = db_exec (db, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF; PRAGMA cache_size = -65536; BEGIN;");
+    while (ok && (n = getline (&line, &cap, fp)) > 0) {
+        line_no++;
+        if (sql.empty ()) {
+            statement_line = line_no;
+        }
+        sql.append (line, n);
+        /* a statement can only end on a line ending in ';', which spares
+           sqlite3_complete rescanning posts line by line */
+        while (n > 0 && isspace ((unsigned char)line[n - 1])) {
+            n--;
+        }
+        if (n == 0 || line[n - 1] != ';' || ! sqlite3_complete (sql.c_str ())) {
+            continue;
+        }
+        if (dump_statement_is (sql, "CREATE INDEX") || dump_statement_is (sql, "CREATE UNIQUE INDEX")) {
+            indexes.push_back (sql);
+        } else if ( ! dump_statement_is (sql, "BEGIN") && ! dump_statement_is (sql, "COMMIT") && ! dump_statement_is (sql, "END")) {
+            if (sqlite3_exec (db, sql.c_str (), NULL, NULL, &error) != SQLITE_OK) {
+                printf ("Restore failed at line %ld: %s\n", statement_line, error);
+                sqlite3_free (error);
+                ok = false;
+            }
+            statements++;
+        }
+        sql.clear ();
+    }
+    free (line);
+    if (ok && ferror (fp)) {
+        printf ("Could not read %s\n", filename.c_str ());
+        ok = false;
+    }
+    fclose (fp);
+    loaded = now_ms ();
+    for (size_t i = 0; ok && i < indexes.size (); i++) {
+        ok = db_exec (db, indexes[i].c_str ());
+    }
+    indexed = now_ms ();
+    ok = ok && db_exec (db, "ANALYZE; COMMIT;");
+    if ( ! ok) {
+        return false;
+    }
+    printf ("Restored %ld statements and %zu indexes in %.0f ms: load %.0f ms, indexes %.0f ms, analyze %.0f ms\n",
+        statements, indexes.size (), now_ms () - start, loaded - start, indexed - loaded, now_ms () - indexed);
+    return db_configure (db, DB_WRITER);
 }
 
-#endif /* _SQLITE_DUMP_H */
\ No newline at end of file
+#endif /* _SQLITE_DUMP_H */
@@ -2,16 +2,121 @@
 #define _ENTRY_H
 
 #include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include "sqlite3.h"
+#include "html.h"
 #include "util.h"
+#include "category.h"
+#include "tag.h"
 
+// A post with everything its page shows, terms resolved.
 typedef struct {
-    std::string title, excerpt, content;
-    term_t []category, []tag;
+    long long id;
+    std::string slug, title, excerpt, content, pubdate;
+    std::vector<term_t> category, tag;
 } entry_t;
 
-std::string the_entry_url(term_t *t, std::string domain) {
-    domain = rtrim(domain, "/");
-    return domain + t->slug + "/";
+// Appends the URL of the post with slug to out; domain as for
+// the_term_url().
+void the_entry_url(std::string_view slug, std::string_view domain, std::string &out) {
+    out.append(domain) += '/';
+    encode_url_to(slug, out);
+    out += '/';
 }
 
-#endif
\ No newline at end of file
+void the_entry_url(const entry_t *e, std::string_view domain, std::string &out) {
+    the_entry_url(e->slug, domain, out);
+}
+// What an entry holds on the heap, roughly, for sizing caches of them.
+size_t entry_bytes(const entry_t &entry) {
+    size_t bytes = sizeof(entry_t) + entry.slug.capacity() + entry.title.capacity() + entry.excerpt.capacity()
+        + entry.content.capacity() + entry.pubdate.capacity();
+    const std::vector<term_t> *lists[] = { &entry.category, &entry.tag };
+    for (int i = 0; i < 2; i++) {
+        bytes += lists[i]->capacity() * sizeof(term_t);
+        for (auto term = lists[i]->begin(); term != lists[i]->end(); ++term) {
+            bytes += term->name.capacity() + term->slug.capacity();
+        }
+    }
+    return bytes;
+}
+// Loads the post and its terms. post_terms does not record whether a term
+// is a tag or a category; the post's tags column lists the tags, so the
+// other terms are its categories.
+bool load_entry(sqlite3 *db, const std::string &slug, entry_t &entry) {
+    sqlite3_stmt *stmt = NULL;
+    std::string tags;
+    if (sqlite3_prepare_v2(db, "SELECT id, slug, title, excerpt, content, pubdate, tags FROM posts WHERE slug = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, slug.c_str(), slug.size(), SQLITE_STATIC);
+    bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        entry.id = sqlite3_column_int64(stmt, 0);
+        entry.slug = (const char*)sqlite3_column_text(stmt, 1);
+        entry.title = (const char*)sqlite3_column_text(stmt, 2);
+        entry.excerpt = (const char*)sqlite3_column_text(stmt, 3);
+        entry.content = (const char*)sqlite3_column_text(stmt, 4);
+        entry.pubdate = (const char*)sqlite3_column_text(stmt, 5);
+        tags = (const char*)sqlite3_column_text(stmt, 6);
+    }
+    sqlite3_finalize(stmt);
+    if ( ! found) {
+        return false;
+    }
+    std::vector<std::string> tag_names;
+    std::stringstream stream(tags);
+    for (std::string name; std::getline(stream, name, ',');) {
+        tag_names.push_back(trim(name));
+    }
+    if (sqlite3_prepare_v2(db, "SELECT t.id, t.name, t.slug, t.post_count FROM post_terms pt JOIN terms t ON t.id = pt.term_id"
+            " WHERE pt.post_id = ? ORDER BY t.name;", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, entry.id);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        term_t term;
+        term.id = sqlite3_column_int64(stmt, 0);
+        term.name = (const char*)sqlite3_column_text(stmt, 1);
+        term.slug = (const char*)sqlite3_column_text(stmt, 2);
+        term.count = sqlite3_column_int(stmt, 3);
+        bool is_tag = std::find(tag_names.begin(), tag_names.end(), term.name) != tag_names.end();
+        (is_tag ? entry.tag : entry.category).push_back(term);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// The terms of a post as links, built by term_url (the_term_url() or
+// the_tag_url()) into a buffer kept between calls and written out at
+// once, so a page of posts allocates nothing for them.
+void render_entry_terms(const char *label, void (*term_url)(const term_t *, std::string_view, std::string &), const std::vector<term_t> &terms) {
+    if (terms.empty()) {
+        return;
+    }
+    static thread_local std::string html;
+    html.assign("<p>").append(label) += ": ";
+    for (auto term = terms.begin(); term != terms.end(); ++term) {
+        html += term == terms.begin() ? "<a href=\"" : ", <a href=\"";
+        term_url(&*term, "", html);
+        html += "\">";
+        htmlspecialchars_to(term->name, html);
+        html += "</a>";
+    }
+    html += "</p>";
+    std::cout.write(html.data(), html.size());
+}
+// content is the HTML rendered from markdown when the post was written.
+void render_entry(const entry_t &entry) {
+    std::cout << "<article><h2>" << htmlspecialchars(entry.title) << "</h2><time>" << htmlspecialchars(entry.pubdate) << "</time>";
+    std::cout << entry.content;
+    render_entry_terms("Categories", the_term_url, entry.category);
+    render_entry_terms("Tags", the_tag_url, entry.tag);
+    std::cout << "</article>";
+}
+
+#endif
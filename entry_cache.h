@@ -0,0 +1,90 @@
+#ifndef _ENTRY_CACHE_H
+#define _ENTRY_CACHE_H
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <iostream>
+#include "sqlite3.h"
+#include "db.h"
+#include "entry.h"
+
+// Hydrated entries of a persistent worker (--serve), most recently used
+// first, evicted from the back once they take more than max_bytes. A hit
+// runs no query on posts or terms. Writes come from other processes
+// (--import, ...): refresh(), called once per request, drops every entry
+// once db_change_watch sees one, since it does not say which posts
+// changed. invalidate() is for writes made in this process.
+class entry_cache {
+    public:
+        entry_cache(sqlite3 *db, size_t max_bytes) : hits(0), misses(0), evictions(0), bytes(0), db(db), max_bytes(max_bytes), watch(db) {
+        }
+        // The entry for slug, loaded on a miss; NULL when there is no such
+        // post. Valid until the next call.
+        const entry_t *get(const std::string &slug) {
+            auto found = index.find(slug);
+            if (found != index.end()) {
+                hits++;
+                entries.splice(entries.begin(), entries, found->second);
+                return &found->second->entry;
+            }
+            misses++;
+            item_t item;
+            if ( ! load_entry(db, slug, item.entry)) {
+                return NULL;
+            }
+            item.bytes = entry_bytes(item.entry) + slug.capacity();
+            entries.push_front(std::move(item));
+            index[slug] = entries.begin();
+            bytes += item.bytes;
+            evict();
+            return &entries.front().entry;
+        }
+        void refresh() {
+            if (watch.changed()) {
+                clear();
+            }
+        }
+        void invalidate(const std::string &slug) {
+            auto found = index.find(slug);
+            if (found == index.end()) {
+                return;
+            }
+            bytes -= found->second->bytes;
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        void clear() {
+            entries.clear();
+            index.clear();
+            bytes = 0;
+        }
+        size_t size() const {
+            return entries.size();
+        }
+        long long hits, misses, evictions;
+        size_t bytes;
+    private:
+        typedef struct {
+            entry_t entry;
+            size_t bytes;
+        } item_t;
+        sqlite3 *db;
+        size_t max_bytes;
+        db_change_watch watch;
+        std::list<item_t> entries;
+        std::unordered_map<std::string, std::list<item_t>::iterator> index;
+
+        // the entry just added stays even when it alone is over the limit
+        void evict() {
+            while (bytes > max_bytes && entries.size() > 1) {
+                item_t &last = entries.back();
+                bytes -= last.bytes;
+                index.erase(last.entry.slug);
+                entries.pop_back();
+                evictions++;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _FEED_H
+#define _FEED_H
+
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include <string_view>
+#include "sqlite3.h"
+#include "html.h"
+#include "http.h"
+#include "util.h"
+#include "config.h"
+
+// RSS 2.0 of the newest posts, "/feed/", or of one term's newest posts,
+// "/tu-khoa/<slug>/feed/" and "/chuyen-muc/<slug>/feed/". A feed is
+// rendered once from the HTML stored with its posts and kept in the page
+// cache as finished bytes; the writes that purge a post's listings purge
+// its feeds too, so a poll is one stat() until a post in the feed changes.
+const int feed_items = 20;
+
+const char *feed_content_type = "application/rss+xml; charset=utf-8";
+
+bool is_feed_path(const std::string &path) {
+    if (path == "/feed/") {
+        return true;
+    }
+    // other cases of these segments are redirected here by the router
+    return path.size() > 6 && path.compare(path.size() - 6, 6, "/feed/") == 0
+        && (path.compare(0, 9, "/tu-khoa/") == 0 || path.compare(0, 12, "/chuyen-muc/") == 0);
+}
+// content goes out as is inside CDATA; only "]]>" has to be split.
+void append_cdata(std::string &out, std::string_view text) {
+    out += "<![CDATA[";
+    size_t at;
+    while ((at = text.find("]]>")) != std::string_view::npos) {
+        out.append(text.substr(0, at + 2)) += "]]><![CDATA[";
+        text.remove_prefix(at + 2);
+    }
+    out.append(text) += "]]>";
+}
+// Appends the feed of term (a term slug, empty for every post) to out.
+// listing is the path of the page the feed follows, "/" or
+// "/tu-khoa/<slug>/". False when the term does not exist or a query fails.
+bool render_feed(sqlite3 *db, const std::string &term, const std::string &listing, std::string &out) {
+    std::string title = "CPP Blog";
+    sqlite3_stmt *stmt = NULL;
+    if ( ! term.empty()) {
+        if (sqlite3_prepare_v2(db, "SELECT name FROM terms WHERE slug = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, term.c_str(), term.size(), SQLITE_STATIC);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        if (found) {
+            title += " - " + std::string((const char*)sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        if ( ! found) {
+            return false;
+        }
+    }
+    // same orders and indexes as the first page of the listing
+    const char *sql = term.empty()
+        ? "SELECT slug, title, excerpt, content, pubtime FROM posts ORDER BY pubtime DESC, id DESC LIMIT ?2;"
+        : "SELECT p.slug, p.title, p.excerpt, p.content, p.pubtime FROM post_terms pt JOIN posts p ON p.id = pt.post_id"
+            " WHERE pt.term_id = (SELECT id FROM terms WHERE slug = ?1) ORDER BY pt.pubtime DESC, pt.post_id DESC LIMIT ?2;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, term.c_str(), term.size(), SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, feed_items);
+    std::string items, url;
+    long long built = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        std::string_view slug((const char*)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+        long long pubtime = sqlite3_column_int64(stmt, 4);
+        built = std::max(built, pubtime);
+        url.assign(config.domain) += '/';
+        encode_url_to(slug, url);
+        url += '/';
+        url = htmlspecialchars(url);
+        items += "<item><title>" + htmlspecialchars((const char*)sqlite3_column_text(stmt, 1)) + "</title>";
+        items += "<link>" + url + "</link><guid isPermaLink=\"true\">" + url + "</guid>";
+        if (pubtime > 0) {
+            items += "<pubDate>" + http_date((time_t)pubtime) + "</pubDate>";
+        }
+        items += "<description>" + htmlspecialchars((const char*)sqlite3_column_text(stmt, 2)) + "</description>";
+        items += "<content:encoded>";
+        append_cdata(items, std::string_view((const char*)sqlite3_column_text(stmt, 3), sqlite3_column_bytes(stmt, 3)));
+        items += "</content:encoded></item>";
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        return false;
+    }
+    url.assign(config.domain);
+    url += listing;
+    out += "<?xml version=\"1.0\" encoding=\"utf-8\"?>";
+    out += "<rss version=\"2.0\" xmlns:content=\"http://purl.org/rss/1.0/modules/content/\" xmlns:atom=\"http://www.w3.org/2005/Atom\"><channel>";
+    out += "<title>" + htmlspecialchars(title) + "</title><link>" + htmlspecialchars(url) + "</link>";
+    out += "<atom:link href=\"" + htmlspecialchars(url + "feed/") + "\" rel=\"self\" type=\"application/rss+xml\"/>";
+    out += "<description>This is description CPP Blog</description>";
+    if (built > 0) {
+        out += "<lastBuildDate>" + http_date((time_t)built) + "</lastBuildDate>";
+    }
+    out += items;
+    out += "</channel></rss>";
+    return true;
+}
+
+#endif
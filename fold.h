@@ -0,0 +1,227 @@
+#ifndef _FOLD_H
+#define _FOLD_H
+
+#include <stddef.h>
+#include <string>
+
+// Table-driven accent folding for Vietnamese (and the rest of Latin):
+// every codepoint maps to one lowercase ASCII letter or digit, or to one of
+// the markers below. The tables were generated from the Unicode NFD
+// decompositions, with đ/Đ, ø and ł added by hand since they have none.
+#define FOLD_KEEP 0 // no ASCII equivalent, keep the original bytes
+#define FOLD_DROP 1 // combining mark, folds to nothing
+#define FOLD_SEP 2  // punctuation, symbol or space, separates words
+
+// U+0000..U+007F: letters lowercased, digits kept, everything else separates
+const char fold_ascii[0x80] = {
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, 'a', 'b', 'c', 'd', 'e', 'f', 'g',
+    'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w',
+    'x', 'y', 'z', FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, 'a', 'b', 'c', 'd', 'e', 'f', 'g',
+    'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w',
+    'x', 'y', 'z', FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP
+};
+
+// U+0080..U+036F: Latin-1, Latin Extended-A/B and the combining marks
+const char fold_2byte[0x2F0] = {
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_KEEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_KEEP, FOLD_KEEP, FOLD_SEP, FOLD_KEEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_KEEP, FOLD_KEEP, FOLD_SEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_SEP,
+    'a', 'a', 'a', 'a', 'a', 'a', FOLD_KEEP, 'c',
+    'e', 'e', 'e', 'e', 'i', 'i', 'i', 'i',
+    FOLD_KEEP, 'n', 'o', 'o', 'o', 'o', 'o', FOLD_SEP,
+    'o', 'u', 'u', 'u', 'u', 'y', FOLD_KEEP, FOLD_KEEP,
+    'a', 'a', 'a', 'a', 'a', 'a', FOLD_KEEP, 'c',
+    'e', 'e', 'e', 'e', 'i', 'i', 'i', 'i',
+    FOLD_KEEP, 'n', 'o', 'o', 'o', 'o', 'o', FOLD_SEP,
+    'o', 'u', 'u', 'u', 'u', 'y', FOLD_KEEP, 'y',
+    'a', 'a', 'a', 'a', 'a', 'a', 'c', 'c',
+    'c', 'c', 'c', 'c', 'c', 'c', 'd', 'd',
+    'd', 'd', 'e', 'e', 'e', 'e', 'e', 'e',
+    'e', 'e', 'e', 'e', 'g', 'g', 'g', 'g',
+    'g', 'g', 'g', 'g', 'h', 'h', FOLD_KEEP, FOLD_KEEP,
+    'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i',
+    'i', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, 'j', 'j', 'k', 'k',
+    FOLD_KEEP, 'l', 'l', 'l', 'l', 'l', 'l', FOLD_KEEP,
+    FOLD_KEEP, 'l', 'l', 'n', 'n', 'n', 'n', 'n',
+    'n', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, 'o', 'o', 'o', 'o',
+    'o', 'o', FOLD_KEEP, FOLD_KEEP, 'r', 'r', 'r', 'r',
+    'r', 'r', 's', 's', 's', 's', 's', 's',
+    's', 's', 't', 't', 't', 't', FOLD_KEEP, FOLD_KEEP,
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    'u', 'u', 'u', 'u', 'w', 'w', 'y', 'y',
+    'y', 'z', 'z', 'z', 'z', 'z', 'z', FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    'o', 'o', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, 'u',
+    'u', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, 'a', 'a', 'i',
+    'i', 'o', 'o', 'u', 'u', 'u', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', FOLD_KEEP, 'a', 'a',
+    'a', 'a', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, 'g', 'g',
+    'k', 'k', 'o', 'o', 'o', 'o', FOLD_KEEP, FOLD_KEEP,
+    'j', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, 'g', 'g', FOLD_KEEP, FOLD_KEEP,
+    'n', 'n', 'a', 'a', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    'a', 'a', 'a', 'a', 'e', 'e', 'e', 'e',
+    'i', 'i', 'i', 'i', 'o', 'o', 'o', 'o',
+    'r', 'r', 'r', 'r', 'u', 'u', 'u', 'u',
+    's', 's', 't', 't', FOLD_KEEP, FOLD_KEEP, 'h', 'h',
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, 'a', 'a',
+    'e', 'e', 'o', 'o', 'o', 'o', 'o', 'o',
+    'o', 'o', 'y', 'y', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_KEEP, FOLD_SEP, FOLD_KEEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP, FOLD_SEP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP,
+    FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP, FOLD_DROP
+};
+
+// U+1E00..U+1EFF: Latin Extended Additional, where the Vietnamese tone marks live
+const char fold_1e[0x100] = {
+    'a', 'a', 'b', 'b', 'b', 'b', 'b', 'b',
+    'c', 'c', 'd', 'd', 'd', 'd', 'd', 'd',
+    'd', 'd', 'd', 'd', 'e', 'e', 'e', 'e',
+    'e', 'e', 'e', 'e', 'e', 'e', 'f', 'f',
+    'g', 'g', 'h', 'h', 'h', 'h', 'h', 'h',
+    'h', 'h', 'h', 'h', 'i', 'i', 'i', 'i',
+    'k', 'k', 'k', 'k', 'k', 'k', 'l', 'l',
+    'l', 'l', 'l', 'l', 'l', 'l', 'm', 'm',
+    'm', 'm', 'm', 'm', 'n', 'n', 'n', 'n',
+    'n', 'n', 'n', 'n', 'o', 'o', 'o', 'o',
+    'o', 'o', 'o', 'o', 'p', 'p', 'p', 'p',
+    'r', 'r', 'r', 'r', 'r', 'r', 'r', 'r',
+    's', 's', 's', 's', 's', 's', 's', 's',
+    's', 's', 't', 't', 't', 't', 't', 't',
+    't', 't', 'u', 'u', 'u', 'u', 'u', 'u',
+    'u', 'u', 'u', 'u', 'v', 'v', 'v', 'v',
+    'w', 'w', 'w', 'w', 'w', 'w', 'w', 'w',
+    'w', 'w', 'x', 'x', 'x', 'x', 'y', 'y',
+    'z', 'z', 'z', 'z', 'z', 'z', 'h', 't',
+    'w', 'y', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP,
+    'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a',
+    'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a',
+    'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a',
+    'e', 'e', 'e', 'e', 'e', 'e', 'e', 'e',
+    'e', 'e', 'e', 'e', 'e', 'e', 'e', 'e',
+    'i', 'i', 'i', 'i', 'o', 'o', 'o', 'o',
+    'o', 'o', 'o', 'o', 'o', 'o', 'o', 'o',
+    'o', 'o', 'o', 'o', 'o', 'o', 'o', 'o',
+    'o', 'o', 'o', 'o', 'u', 'u', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    'u', 'u', 'y', 'y', 'y', 'y', 'y', 'y',
+    'y', 'y', FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP, FOLD_KEEP
+};
+
+// Folds the codepoint starting at s, with n bytes available. Returns how
+// many bytes it used (at least 1) and stores the ASCII letter or marker in
+// folded. Malformed sequences are kept byte by byte.
+size_t fold_codepoint(const unsigned char *s, size_t n, char &folded) {
+    unsigned char c = s[0];
+    if (c < 0x80) {
+        folded = fold_ascii[c];
+        return 1;
+    }
+    if (c >= 0xC2 && c <= 0xDF && n >= 2 && (s[1] & 0xC0) == 0x80) {
+        unsigned int cp = ((c & 0x1F) << 6) | (s[1] & 0x3F);
+        folded = cp < 0x370 ? fold_2byte[cp - 0x80] : FOLD_KEEP;
+        return 2;
+    }
+    if (c >= 0xE0 && c <= 0xEF && n >= 3 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+        unsigned int cp = ((c & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+        if (cp >= 0x1E00 && cp < 0x1F00) {
+            folded = fold_1e[cp - 0x1E00];
+        } else if ((cp >= 0x2000 && cp < 0x2070) || cp == 0x3000) {
+            // general punctuation: dashes, curly quotes, ellipsis, spaces
+            folded = FOLD_SEP;
+        } else {
+            folded = FOLD_KEEP;
+        }
+        return 3;
+    }
+    folded = FOLD_KEEP;
+    if (c >= 0xF0 && c <= 0xF4 && n >= 4 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80 && (s[3] & 0xC0) == 0x80) {
+        return 4;
+    }
+    return 1;
+}
+// Folds a whole string: accents removed, lowercase, every run of
+// separators turned into a single space. "Từ  khóa, C++" -> "tu khoa c".
+void fold_text(const char *text, size_t len, std::string &out) {
+    const unsigned char *s = (const unsigned char *)text;
+    bool sep = false;
+    size_t i = 0;
+    while (i < len) {
+        char folded;
+        size_t n = fold_codepoint(s + i, len - i, folded);
+        if (folded == FOLD_SEP) {
+            sep = ! out.empty();
+        } else if (folded != FOLD_DROP) {
+            if (sep) {
+                out += ' ';
+                sep = false;
+            }
+            if (folded == FOLD_KEEP) {
+                out.append(text + i, n);
+            } else {
+                out += folded;
+            }
+        }
+        i += n;
+    }
+}
+
+#endif
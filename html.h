@@ -4,23 +4,30 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <sstream>
 #include "util.h"
 
 typedef std::map<std::string, std::string> attribute_t;
-// http://forums.codeguru.com/showthread.php?448809-C-Replacing-HTML-Character-Entities&p=1698435#post1698435
-std::string htmlspecialchars(std::string str) {
-    std::string subs[] = {"\"","'","&","<",">"};
-    std::string reps[] = {"&quot;","&apos;","&amp;","&lt;","&gt;"};
-    size_t found;
-    for(int i = 0; i < 15; i++) {
-        do {
-            found = str.find(subs[i]);
-            if (found != std::string::npos) {
-                str.replace (found,subs[i].length(),reps[i]);
-            }
-        } while (found != std::string::npos);
+// Appends str to out escaped, so rendering into a reused buffer allocates
+// nothing once the buffer has grown.
+void htmlspecialchars_to(std::string_view str, std::string &out) {
+    for (size_t i = 0; i < str.size(); i++) {
+        switch (str[i]) {
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&apos;"; break;
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            default: out += str[i]; break;
+        }
     }
-    return str;
+}
+
+std::string htmlspecialchars(const std::string &str) {
+    std::string result;
+    result.reserve(str.size());
+    htmlspecialchars_to(str, result);
+    return result;
 }
 // http://www.cplusplus.com/reference/map/map/insert/
 std::string html_attributes(attribute_t *attrs = NULL) {
@@ -58,8 +65,8 @@ void meta_equiv(){
 void meta_viewport() {
 	std::cout << "<meta name=\"viewport\" content=\"width=device-width,initial-scale=1.0,maximum-scale=1.0,minimum-scale=1.0\" />";
 }
-void site_stylesheet(std::string domain = "/") {
-	std::cout << "<link href=\"" << rtrim(domain,"/") << "/style.css\" rel=\"stylesheet\" type=\"text/css\" />";
+void site_stylesheet(std::string_view domain = "/") {
+	std::cout << "<link href=\"" << rtrim_view(domain, "/") << "/style.css\" rel=\"stylesheet\" type=\"text/css\" />";
 }
 void head_end() {
     std::cout << "</head>";
@@ -114,4 +121,8 @@ void blockquote_tag(std::string text, attribute_t *attrs = NULL) {
 void hr_tag(attribute_t *attrs = NULL) {
     std::cout << "<hr" << html_attributes(attrs) << " />";
 }
+
+void search_form(std::string q = "") {
+    std::cout << "<form action=\"/tim-kiem\" method=\"get\" role=\"search\"><input type=\"search\" name=\"q\" value=\"" << htmlspecialchars(q) << "\" /><button type=\"submit\">Search</button></form>";
+}
 #endif
@@ -2,10 +2,290 @@
 #define _HTTP_H
 
 #include <iostream>
+#include <streambuf>
 #include <string>
+#include <vector>
+#include <utility>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "util.h"
+#include "utf8.h"
 
-void set_content_type(std::string content_type) {
-    std::cout << "Content-Type: " << content_type << "\r\n\r\n";
+// Content codings a stored page can be served in, in order of preference.
+enum content_coding_t {
+    CODING_IDENTITY = 0,
+    CODING_GZIP,
+    CODING_BROTLI
+};
+
+const char *coding_name(content_coding_t coding) {
+    switch (coding) {
+        case CODING_GZIP: return "gzip";
+        case CODING_BROTLI: return "br";
+        default: return "identity";
+    }
+}
+// Returns the q-value the Accept-Encoding header gives to coding, taking
+// "*" into account, or -1 when the header does not mention it at all.
+double coding_quality(const char *header, const char *coding) {
+    double wildcard = -1;
+    const char *p = header;
+    while (p != NULL && *p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        const char *name = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        size_t len = p - name;
+        double q = 1;
+        while (*p && *p != ',') {
+            if (*p == ';') {
+                p++;
+                while (*p == ' ' || *p == '\t') {
+                    p++;
+                }
+                if ((*p == 'q' || *p == 'Q') && p[1] == '=') {
+                    q = atof(p + 2);
+                }
+            } else {
+                p++;
+            }
+        }
+        if (len == strlen(coding) && strncasecmp(name, coding, len) == 0) {
+            return q;
+        }
+        if (len == 1 && *name == '*') {
+            wildcard = q;
+        }
+    }
+    return wildcard;
+}
+
+content_coding_t negotiate_coding(const char *header) {
+    if (header == NULL) {
+        return CODING_IDENTITY;
+    }
+    double br = coding_quality(header, "br");
+    double gzip = coding_quality(header, "gzip");
+    if (br > 0 && br >= gzip) {
+        return CODING_BROTLI;
+    }
+    if (gzip > 0) {
+        return CODING_GZIP;
+    }
+    return CODING_IDENTITY;
+}
+
+// Response being built for the current request. Handlers collect the
+// status and headers here; nothing reaches the client until send_headers()
+// or send_response() emits them all at once.
+typedef struct {
+    int status;
+    std::vector<std::pair<std::string, std::string> > headers;
+    bool headers_sent;
+} response_t;
+
+response_t response = { 200, std::vector<std::pair<std::string, std::string> >(), false };
+
+void reset_response() {
+    response.status = 200;
+    response.headers.clear();
+    response.headers_sent = false;
+}
+
+const char *status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+    }
+}
+
+void set_status(int status) {
+    response.status = status;
+}
+// Replaces any earlier value of the same header, names are case-insensitive.
+void set_header(const std::string &name, const std::string &value) {
+    for (auto header = response.headers.begin(); header != response.headers.end(); ++header) {
+        if (strcasecmp(header->first.c_str(), name.c_str()) == 0) {
+            header->second = value;
+            return;
+        }
+    }
+    response.headers.push_back(std::make_pair(name, value));
+}
+
+void set_content_type(const std::string &content_type) {
+    set_header("Content-Type", content_type);
+}
+
+void redirect(const std::string &location, int status = 301) {
+    set_status(status);
+    set_header("Location", location);
+}
+
+// Value of a QUERY_STRING parameter, decoded; empty when it is absent.
+// "%XX" escapes decode to any byte, and values are printed back into
+// pages, so invalid UTF-8 is replaced.
+std::string query_param(const std::string &name) {
+    const char *query = getenv("QUERY_STRING");
+    if (query == NULL) {
+        return "";
+    }
+    std::string qs(query);
+    size_t pos = 0;
+    while (pos <= qs.size()) {
+        size_t end = qs.find('&', pos);
+        if (end == std::string::npos) {
+            end = qs.size();
+        }
+        size_t eq = qs.find('=', pos);
+        if (eq != std::string::npos && eq < end && qs.compare(pos, eq - pos, name) == 0 && eq - pos == name.size()) {
+            std::string value = decode_url(std::string_view(qs).substr(eq + 1, end - eq - 1));
+            utf8_repair(value);
+            return value;
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
+bool is_head_request() {
+    const char *method = getenv("REQUEST_METHOD");
+    return method != NULL && strcmp(method, "HEAD") == 0;
+}
+// Emits the status and header block once; later calls are no-ops.
+void send_headers() {
+    if (response.headers_sent) {
+        return;
+    }
+    response.headers_sent = true;
+    if (response.status != 200) {
+        std::cout << "Status: " << response.status << " " << status_text(response.status) << "\r\n";
+    }
+    for (auto header = response.headers.begin(); header != response.headers.end(); ++header) {
+        std::cout << header->first << ": " << header->second << "\r\n";
+    }
+    std::cout << "\r\n";
+}
+// Sends a fully buffered body with its exact Content-Length.
+void send_response(const std::string &body) {
+    set_header("Content-Length", std::to_string(body.size()));
+    send_headers();
+    if ( ! is_head_request()) {
+        std::cout << body;
+    }
+}
+// "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string http_date(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buff[40];
+    strftime(buff, sizeof(buff), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buff;
+}
+// -1 when value is not an HTTP date.
+time_t parse_http_date(const char *value) {
+    struct tm tm = {};
+    const char *end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return end != NULL && *end == '\0' ? timegm(&tm) : (time_t)-1;
+}
+// Whether an If-None-Match list names etag; "W/" tags compare weakly, as
+// a GET may.
+bool etag_listed(const char *header, const std::string &etag) {
+    std::string_view list(header);
+    while ( ! list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view tag = trim_view(list.substr(0, comma), " \t");
+        list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag.remove_prefix(2);
+        }
+        if (tag == "*" || tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+// Sets the validators of a stored response and tells whether the client's
+// conditional GET shows it already holds that copy. If-None-Match, when
+// sent, decides alone.
+bool not_modified(const std::string &etag, time_t modified) {
+    set_header("ETag", etag);
+    set_header("Last-Modified", http_date(modified));
+    const char *match = getenv("HTTP_IF_NONE_MATCH");
+    if (match != NULL) {
+        return etag_listed(match, etag);
+    }
+    const char *since = getenv("HTTP_IF_MODIFIED_SINCE");
+    if (since == NULL) {
+        return false;
+    }
+    time_t t = parse_http_date(since);
+    return t != (time_t)-1 && modified <= t;
+}
+// A 304 has no body and no Content-Length: the client keeps the one it has.
+void send_not_modified() {
+    set_status(304);
+    set_header("Vary", "Accept-Encoding");
+    send_headers();
+}
+// Sends a complete, already encoded body. Every variant advertises Vary so
+// shared caches keep the gzip, brotli and identity copies apart.
+void send_encoded(const std::string &body, content_coding_t coding) {
+    if (coding != CODING_IDENTITY) {
+        set_header("Content-Encoding", coding_name(coding));
+    }
+    set_header("Vary", "Accept-Encoding");
+    send_response(body);
+}
+// Starts a response whose length is not known yet. Used when a page is
+// rendered straight to the client instead of being buffered first; nginx
+// is told not to buffer it so flushed bytes are passed on right away.
+void begin_stream() {
+    set_header("Vary", "Accept-Encoding");
+    set_header("X-Accel-Buffering", "no");
+    send_headers();
+}
+// Pushes everything written so far to the client. Called right after the
+// <head> so the browser fetches the stylesheet while the body renders.
+void flush_output() {
+    std::cout.flush();
 }
+// Forwards output to another streambuf while keeping a copy, so a page can
+// be streamed to the client and still be stored in the cache afterwards.
+class tee_buf : public std::streambuf {
+    public:
+        tee_buf(std::streambuf *out, std::string &copy) : out(out), copy(copy) {}
+    protected:
+        int_type overflow(int_type c) override {
+            if (c != traits_type::eof()) {
+                copy += traits_type::to_char_type(c);
+                return out->sputc(traits_type::to_char_type(c));
+            }
+            return traits_type::not_eof(c);
+        }
+        std::streamsize xsputn(const char *s, std::streamsize n) override {
+            copy.append(s, n);
+            return out->sputn(s, n);
+        }
+        int sync() override {
+            return out->pubsync();
+        }
+    private:
+        std::streambuf *out;
+        std::string &copy;
+};
 
 #endif
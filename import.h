@@ -0,0 +1,448 @@
+#ifndef _IMPORT_H
+#define _IMPORT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <algorithm>
+#include "sqlite3.h"
+#include "util.h"
+#include "db.h"
+#include "slug.h"
+#include "utf8.h"
+#include "config.h"
+#include "cache.h"
+#include "archive.h"
+#include "markdown.h"
+
+// A markdown file with its front matter, parsed and rendered:
+//
+//   ---
+//   title: Xin chào
+//   slug: xin-chao
+//   date: 2020-01-02 10:00
+//   tags: [c++, sqlite]
+//   categories: Lập trình
+//   ---
+//   body in markdown
+//
+// Only title is required. The slug defaults to the folded title (see
+// route_slug for titles that fold to nothing), numbered when another post
+// holds it; a slug given is folded too. The date defaults to the file's
+// mtime and the excerpt to the start of the first paragraph.
+typedef struct {
+    std::string file, error;
+    std::string title, slug, pubdate, excerpt, content;
+    long long pubtime;
+    bool slug_from_title;
+    // invalid UTF-8 sequences replaced while reading the file
+    size_t repaired;
+    std::vector<std::string> tags, categories;
+} import_post_t;
+
+// "a, b", "[a, b]" or "['a', "b"]" as a list of names.
+std::vector<std::string> front_matter_list(std::string value) {
+    std::vector<std::string> names;
+    trim(value);
+    if (value.size() >= 2 && value[0] == '[' && value[value.size() - 1] == ']') {
+        value = value.substr(1, value.size() - 2);
+    }
+    std::stringstream stream(value);
+    for (std::string name; std::getline(stream, name, ',');) {
+        trim(trim(name), "\"'");
+        if ( ! name.empty()) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+// Accepts "2020-01-02", "2020-01-02 10:00", "2020-01-02T10:00:00" and
+// the like, and writes them the way pubdate is stored.
+bool front_matter_date(const std::string &value, std::string &pubdate) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int n = sscanf(value.c_str(), "%d-%d-%d%*1[ T]%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (n != 3 && n < 5) {
+        return false;
+    }
+    char buff[32];
+    snprintf(buff, sizeof(buff), "%04d-%02d-%02d %02d:%02d:%02d", tm.tm_year, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    pubdate = buff;
+    return true;
+}
+// Text of the first paragraph without markup, cut on a UTF-8 boundary.
+std::string html_excerpt(const std::string &html, size_t max_len = 200) {
+    size_t start = html.find("<p>"), end;
+    if (start == std::string::npos) {
+        start = 0;
+        end = html.size();
+    } else {
+        end = html.find("</p>", start);
+        start += 3;
+    }
+    std::string text;
+    bool in_tag = false;
+    for (size_t i = start; i < end && i < html.size(); i++) {
+        if (html[i] == '<') {
+            in_tag = true;
+        } else if (html[i] == '>') {
+            in_tag = false;
+        } else if ( ! in_tag) {
+            text += html[i];
+        }
+    }
+    trim(text);
+    if (text.size() > max_len) {
+        size_t cut = max_len;
+        while (cut > 0 && ((unsigned char)text[cut] & 0xC0) == 0x80) {
+            cut--;
+        }
+        text = text.substr(0, cut) + "...";
+    }
+    return text;
+}
+
+bool parse_markdown_post(const std::string &file, const Parser &parser, import_post_t &post) {
+    post.file = file;
+    std::string data;
+    if ( ! read_file(file, data)) {
+        post.error = "could not read";
+        return false;
+    }
+    // everything stored comes out of data, so it is checked here once
+    if ( ! utf8_ingest(data, config.ingest_repair, config.ingest_nfc, post.repaired)) {
+        post.error = "invalid UTF-8 at byte " + std::to_string(utf8_valid_length(data));
+        return false;
+    }
+    std::stringstream stream(data);
+    std::string line;
+    if (std::getline(stream, line) && trim(line) == "---") {
+        while (std::getline(stream, line) && trim(line) != "---") {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string key = line.substr(0, colon), value = line.substr(colon + 1);
+            trim(key);
+            trim(trim(value), "\"'");
+            if (key == "title") {
+                post.title = value;
+            } else if (key == "slug") {
+                // folded like a title, so "Xin Chào/" is stored as
+                // "xin-chao", a path segment the router can reach
+                post.slug = slugify(value);
+                if (post.slug.empty() || is_route_segment(post.slug)) {
+                    post.error = "bad slug " + value;
+                    return false;
+                }
+            } else if (key == "date" && ! front_matter_date(value, post.pubdate)) {
+                post.error = "bad date " + value;
+                return false;
+            } else if (key == "excerpt") {
+                post.excerpt = value;
+            } else if (key == "tags") {
+                post.tags = front_matter_list(value);
+            } else if (key == "categories") {
+                post.categories = front_matter_list(value);
+            }
+        }
+    } else {
+        // no front matter, the first line is part of the body
+        stream.clear();
+        stream.seekg(0);
+    }
+    if (post.title.empty()) {
+        post.error = "no title";
+        return false;
+    }
+    if (post.slug.empty()) {
+        post.slug = route_slug(post.title, "post");
+        post.slug_from_title = true;
+    }
+    if (post.pubdate.empty()) {
+        struct stat st;
+        char buff[32];
+        time_t mtime = stat(file.c_str(), &st) == 0 ? st.st_mtime : time(NULL);
+        strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", gmtime(&mtime));
+        post.pubdate = buff;
+    }
+    post.pubtime = pubdate_time(post.pubdate);
+    std::stringstream markdown;
+    markdown << stream.rdbuf();
+    post.content = parser.Parse(markdown);
+    if (post.excerpt.empty()) {
+        post.excerpt = html_excerpt(post.content);
+    }
+    return true;
+}
+
+void find_markdown_files(const std::string &dir, std::vector<std::string> &files) {
+    DIR *dp = opendir(dir.c_str());
+    if (dp == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != NULL) {
+        std::string name = entry->d_name;
+        if (name.empty() || name[0] == '.') {
+            continue;
+        }
+        std::string path = dir + PATH_SEPARATOR + name;
+        if (is_dir(path)) {
+            find_markdown_files(path, files);
+        } else if (name.size() > 3 && name.compare(name.size() - 3, 3, ".md") == 0) {
+            files.push_back(path);
+        }
+    }
+    closedir(dp);
+}
+// Parses files[begin, end) on every core. The markdown parser is mostly
+// regular expressions, so this is where an import spends its CPU time.
+std::vector<import_post_t> parse_markdown_batch(const std::vector<std::string> &files, size_t begin, size_t end) {
+    std::vector<import_post_t> posts(end - begin);
+    std::atomic<size_t> next(begin);
+    unsigned int workers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < workers; i++) {
+        threads.push_back(std::thread([&]() {
+            Parser parser;
+            for (size_t j; (j = next++) < end;) {
+                parse_markdown_post(files[j], parser, posts[j - begin]);
+            }
+        }));
+    }
+    for (auto thread = threads.begin(); thread != threads.end(); ++thread) {
+        thread->join();
+    }
+    return posts;
+}
+
+class post_importer {
+    public:
+        post_importer(sqlite3 *db, const std::string &dir) : db(db), dir(dir), find_source(NULL), insert_post(NULL), insert_term(NULL), insert_post_term(NULL) {}
+        ~post_importer() {
+            sqlite3_finalize(find_source);
+            sqlite3_finalize(insert_post);
+            sqlite3_finalize(insert_term);
+            sqlite3_finalize(insert_post_term);
+        }
+        bool prepare() {
+            sqlite3_stmt *stmt = NULL;
+            if (sqlite3_prepare_v2(db, "SELECT name, id, slug FROM terms;", -1, &stmt, NULL) != SQLITE_OK) {
+                return false;
+            }
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                import_term_t &term = term_names[(const char*)sqlite3_column_text(stmt, 0)];
+                term.id = sqlite3_column_int64(stmt, 1);
+                term.slug = (const char*)sqlite3_column_text(stmt, 2);
+            }
+            sqlite3_finalize(stmt);
+            return sqlite3_prepare_v2(db, "SELECT 1 FROM posts WHERE source = ? AND source != '';", -1, &find_source, NULL) == SQLITE_OK
+                && sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO posts (title, slug, excerpt, content, pubdate, tags, pubtime, source) VALUES (?, ?, ?, ?, ?, ?, ?, ?);", -1, &insert_post, NULL) == SQLITE_OK
+                && sqlite3_prepare_v2(db, "INSERT INTO terms (name, slug) VALUES (?, ?);", -1, &insert_term, NULL) == SQLITE_OK
+                && sqlite3_prepare_v2(db, "INSERT INTO post_terms (post_id, term_id) VALUES (?, ?);", -1, &insert_post_term, NULL) == SQLITE_OK;
+        }
+        // Writes a batch in one transaction. Posts imported before from the
+        // same file, or whose front matter names a slug that is taken, are
+        // left alone and counted as skipped; a slug made from the title
+        // gets the next free "-2", "-3", ... when it is taken. The terms
+        // and months the batch touched count only once it committed.
+        bool write(const std::vector<import_post_t> &posts) {
+            batch_touched.clear();
+            batch_months.clear();
+            if ( ! db_exec(db, "BEGIN IMMEDIATE;")) {
+                return false;
+            }
+            for (auto post = posts.begin(); post != posts.end(); ++post) {
+                if ( ! post->error.empty()) {
+                    std::cout << post->file << ": " << post->error << std::endl;
+                    failed++;
+                    continue;
+                }
+                if (post->repaired > 0) {
+                    std::cout << post->file << ": replaced " << post->repaired << " invalid UTF-8 sequences" << std::endl;
+                }
+                if ( ! write_post(*post)) {
+                    std::cout << post->file << ": " << sqlite3_errmsg(db) << std::endl;
+                    db_exec(db, "ROLLBACK;");
+                    return false;
+                }
+            }
+            if ( ! db_exec(db, "COMMIT;")) {
+                return false;
+            }
+            touched.insert(batch_touched.begin(), batch_touched.end());
+            months.insert(batch_months.begin(), batch_months.end());
+            return true;
+        }
+        std::vector<std::string> touched_terms() const {
+            return std::vector<std::string>(touched.begin(), touched.end());
+        }
+        std::vector<std::string> touched_archives() const {
+            std::vector<std::string> urls;
+            for (auto month = months.begin(); month != months.end(); ++month) {
+                urls.push_back(archive_url(*month));
+            }
+            return urls;
+        }
+        long long posts = 0, skipped = 0, failed = 0, terms = 0, links = 0;
+    private:
+        sqlite3 *db;
+        std::string dir;
+        sqlite3_stmt *find_source, *insert_post, *insert_term, *insert_post_term;
+        typedef struct {
+            sqlite3_int64 id;
+            std::string slug;
+        } import_term_t;
+        // terms by name: names that fold alike ("C", "C#", "c++") are
+        // different terms with numbered slugs
+        std::map<std::string, import_term_t> term_names;
+        std::set<std::string> touched, batch_touched;
+        std::set<int> months, batch_months;
+
+        // The term called name, created when there is none; NULL when
+        // a query fails.
+        const import_term_t *find_term(const std::string &name) {
+            auto found = term_names.find(name);
+            if (found != term_names.end()) {
+                return &found->second;
+            }
+            std::string slug = unique_slug(db, "terms", route_slug(name, "term"));
+            if (slug.empty()) {
+                return NULL;
+            }
+            sqlite3_bind_text(insert_term, 1, name.c_str(), name.size(), SQLITE_STATIC);
+            sqlite3_bind_text(insert_term, 2, slug.c_str(), slug.size(), SQLITE_STATIC);
+            int rc = sqlite3_step(insert_term);
+            sqlite3_reset(insert_term);
+            if (rc != SQLITE_DONE) {
+                return NULL;
+            }
+            terms++;
+            import_term_t &term = term_names[name];
+            term.id = sqlite3_last_insert_rowid(db);
+            term.slug = slug;
+            return &term;
+        }
+        bool write_post(const import_post_t &post) {
+            // files are found under dir, so this is the path below it
+            std::string source = post.file.substr(dir.size() + 1);
+            sqlite3_bind_text(find_source, 1, source.c_str(), source.size(), SQLITE_STATIC);
+            int rc = sqlite3_step(find_source);
+            sqlite3_reset(find_source);
+            if (rc == SQLITE_ROW) {
+                skipped++;
+                return true;
+            }
+            if (rc != SQLITE_DONE) {
+                return false;
+            }
+            std::string slug = post.slug_from_title ? unique_slug(db, "posts", post.slug) : post.slug;
+            if (slug.empty()) {
+                return false;
+            }
+            std::string tags;
+            for (auto tag = post.tags.begin(); tag != post.tags.end(); ++tag) {
+                tags += (tags.empty() ? "" : ", ") + *tag;
+            }
+            sqlite3_bind_text(insert_post, 1, post.title.c_str(), post.title.size(), SQLITE_STATIC);
+            sqlite3_bind_text(insert_post, 2, slug.c_str(), slug.size(), SQLITE_STATIC);
+            sqlite3_bind_text(insert_post, 3, post.excerpt.c_str(), post.excerpt.size(), SQLITE_STATIC);
+            sqlite3_bind_text(insert_post, 4, post.content.c_str(), post.content.size(), SQLITE_STATIC);
+            sqlite3_bind_text(insert_post, 5, post.pubdate.c_str(), post.pubdate.size(), SQLITE_STATIC);
+            sqlite3_bind_text(insert_post, 6, tags.c_str(), tags.size(), SQLITE_STATIC);
+            sqlite3_bind_int64(insert_post, 7, post.pubtime);
+            sqlite3_bind_text(insert_post, 8, source.c_str(), source.size(), SQLITE_STATIC);
+            rc = sqlite3_step(insert_post);
+            sqlite3_reset(insert_post);
+            if (rc != SQLITE_DONE) {
+                return false;
+            }
+            if (sqlite3_changes(db) == 0) {
+                skipped++;
+                return true;
+            }
+            posts++;
+            if (post.pubtime > 0) {
+                batch_months.insert(pubtime_month(post.pubtime));
+            }
+            sqlite3_int64 post_id = sqlite3_last_insert_rowid(db);
+            std::vector<std::string> names(post.tags);
+            names.insert(names.end(), post.categories.begin(), post.categories.end());
+            std::vector<sqlite3_int64> linked;
+            for (auto name = names.begin(); name != names.end(); ++name) {
+                const import_term_t *term = find_term(*name);
+                if (term == NULL) {
+                    return false;
+                }
+                if (std::find(linked.begin(), linked.end(), term->id) != linked.end()) {
+                    continue;
+                }
+                linked.push_back(term->id);
+                sqlite3_bind_int64(insert_post_term, 1, post_id);
+                sqlite3_bind_int64(insert_post_term, 2, term->id);
+                rc = sqlite3_step(insert_post_term);
+                sqlite3_reset(insert_post_term);
+                if (rc != SQLITE_DONE) {
+                    return false;
+                }
+                links++;
+                batch_touched.insert(term->slug);
+            }
+            return true;
+        }
+};
+// --import <dir>: every *.md file under dir, parsed in parallel batches.
+// Each batch is written in one transaction while the next one is parsed.
+// Hands back the slugs of the terms and the archive pages that got posts,
+// also when a batch failed: the batches before it stay committed.
+bool import_posts(sqlite3 *db, const std::string &dir, std::vector<std::string> &touched_terms, std::vector<std::string> &touched_archives) {
+    const size_t batch = 5000;
+    std::vector<std::string> files;
+    find_markdown_files(dir, files);
+    std::sort(files.begin(), files.end());
+    post_importer importer(db, dir);
+    if ( ! importer.prepare()) {
+        std::cout << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    double start = now_ms();
+    std::future<std::vector<import_post_t> > next = std::async(std::launch::async, parse_markdown_batch, std::cref(files), 0, std::min(batch, files.size()));
+    for (size_t begin = 0; begin < files.size(); begin += batch) {
+        std::vector<import_post_t> posts = next.get();
+        size_t end = std::min(begin + batch, files.size());
+        if (end < files.size()) {
+            next = std::async(std::launch::async, parse_markdown_batch, std::cref(files), end, std::min(end + batch, files.size()));
+        }
+        if ( ! importer.write(posts)) {
+            if (next.valid()) {
+                next.wait();
+            }
+            touched_terms = importer.touched_terms();
+            touched_archives = importer.touched_archives();
+            return false;
+        }
+    }
+    double ms = now_ms() - start;
+    double secs = ms > 0 ? ms / 1000 : 0.001;
+    long long rows = importer.posts + importer.terms + importer.links;
+    std::cout << "Imported " << importer.posts << " posts, " << importer.terms << " new terms, " << importer.links << " post terms from " << files.size() << " files ("
+        << importer.skipped << " skipped, " << importer.failed << " failed) in " << ms << " ms: "
+        << (long long)(importer.posts / secs) << " posts/s, " << (long long)(rows / secs) << " rows/s" << std::endl;
+    touched_terms = importer.touched_terms();
+    touched_archives = importer.touched_archives();
+    return true;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _LISTING_H
+#define _LISTING_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "sqlite3.h"
+#include "html.h"
+#include "archive.h"
+#include "entry.h"
+#include "util.h"
+
+typedef struct {
+    sqlite3_int64 id;
+    std::string slug, title, excerpt, pubdate;
+} listing_post_t;
+
+// Listings are paged by keyset on (pubtime, id), newest first. A page is
+// addressed by the post it continues from, so "/cu-hon/42/" holds the
+// posts older than post 42 and "/moi-hon/42/" the ones newer than it.
+// Every page is a single range scan of posts_pubtime, or of
+// post_terms_listing for a term, however deep it is; a month's archive
+// only narrows the range.
+std::string listing_page_url(const std::string &base, bool newer, sqlite3_int64 id) {
+    return base + (newer ? "moi-hon/" : "cu-hon/") + std::to_string(id) + "/";
+}
+// One page of posts after cursor (0 for the first page), in display
+// order. term is a term slug, or empty for every post; month (yyyymm)
+// limits the listing to that month's posts, 0 for all of them.
+bool list_posts(sqlite3 *db, const std::string &term, int month, sqlite3_int64 cursor, bool newer, int limit, std::vector<listing_post_t> &posts) {
+    std::string sql;
+    const char *op = newer ? ">" : "<", *order = newer ? "ASC" : "DESC";
+    if (term.empty()) {
+        sql = "SELECT id, slug, title, excerpt, pubdate FROM posts WHERE 1";
+        if (month > 0) {
+            sql += " AND pubtime >= ?4 AND pubtime < ?5";
+        }
+        if (cursor > 0) {
+            sql += std::string(" AND (pubtime, id) ") + op + " (SELECT pubtime, id FROM posts WHERE id = ?2)";
+        }
+        sql += std::string(" ORDER BY pubtime ") + order + ", id " + order + " LIMIT ?3;";
+    } else {
+        // post_terms carries its post's pubtime so the term's index alone
+        // yields the page; posts is only read for the rows shown
+        sql = "SELECT p.id, p.slug, p.title, p.excerpt, p.pubdate FROM post_terms pt JOIN posts p ON p.id = pt.post_id"
+            " WHERE pt.term_id = (SELECT id FROM terms WHERE slug = ?1)";
+        if (month > 0) {
+            sql += " AND pt.pubtime >= ?4 AND pt.pubtime < ?5";
+        }
+        if (cursor > 0) {
+            sql += std::string(" AND (pt.pubtime, pt.post_id) ") + op + " (SELECT pubtime, id FROM posts WHERE id = ?2)";
+        }
+        sql += std::string(" ORDER BY pt.pubtime ") + order + ", pt.post_id " + order + " LIMIT ?3;";
+    }
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    long long since = 0, until = 0;
+    if (month > 0) {
+        month_bounds(month, since, until);
+    }
+    sqlite3_bind_text(stmt, 1, term.c_str(), term.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, cursor);
+    sqlite3_bind_int(stmt, 3, limit);
+    sqlite3_bind_int64(stmt, 4, since);
+    sqlite3_bind_int64(stmt, 5, until);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        listing_post_t post;
+        post.id = sqlite3_column_int64(stmt, 0);
+        post.slug = (const char*)sqlite3_column_text(stmt, 1);
+        post.title = (const char*)sqlite3_column_text(stmt, 2);
+        post.excerpt = (const char*)sqlite3_column_text(stmt, 3);
+        post.pubdate = (const char*)sqlite3_column_text(stmt, 4);
+        posts.push_back(post);
+    }
+    sqlite3_finalize(stmt);
+    if (newer) {
+        std::reverse(posts.begin(), posts.end());
+    }
+    return rc == SQLITE_DONE;
+}
+// base is the listing's first page, "/", "/tu-khoa/slug/" or "/2020/01/".
+void render_listing(sqlite3 *db, const std::string &base, const std::string &term, int month, sqlite3_int64 cursor, bool newer) {
+    const int per_page = 10;
+    std::vector<listing_post_t> posts;
+    // one extra row tells whether the listing goes on in that direction
+    if ( ! list_posts(db, term, month, cursor, newer, per_page + 1, posts)) {
+        p_tag("Could not load posts");
+        return;
+    }
+    bool more = posts.size() > (size_t)per_page;
+    if (more) {
+        posts.erase(newer ? posts.begin() : posts.end() - 1);
+    }
+    if (posts.empty()) {
+        p_tag("No posts yet");
+        return;
+    }
+    // each article is built into one reused buffer
+    std::string html;
+    for (auto post = posts.begin(); post != posts.end(); ++post) {
+        html.assign("<article><h3><a href=\"");
+        the_entry_url(post->slug, "", html);
+        html += "\">";
+        htmlspecialchars_to(post->title, html);
+        html += "</a></h3><time>";
+        htmlspecialchars_to(post->pubdate, html);
+        html += "</time><p>";
+        htmlspecialchars_to(post->excerpt, html);
+        html += "</p></article>";
+        std::cout.write(html.data(), html.size());
+    }
+    // the cursor post itself lies on the other side of this page
+    bool has_newer = newer ? more : cursor > 0;
+    bool has_older = newer ? true : more;
+    if ( ! has_newer && ! has_older) {
+        return;
+    }
+    std::cout << "<nav>";
+    if (has_newer) {
+        std::cout << "<a href=\"" << htmlspecialchars(listing_page_url(base, true, posts.front().id)) << "\" rel=\"prev\">Newer posts</a>";
+    }
+    if (has_older) {
+        std::cout << "<a href=\"" << htmlspecialchars(listing_page_url(base, false, posts.back().id)) << "\" rel=\"next\">Older posts</a>";
+    }
+    std::cout << "</nav>";
+}
+
+#endif
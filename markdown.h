@@ -84,6 +84,117 @@ class BlockParser {
         std::function<std::shared_ptr<BlockParser>(const std::string& line)> getBlockParserForLineCallback;
 }; // class BlockParser
 
+class LineParser {
+    public:
+        virtual ~LineParser() {}
+        virtual void Parse(std::string& line) = 0;
+    protected:
+        // The emphasis patterns look ahead to the end of the line for code
+        // at every position, which is quadratic. Without any code on the
+        // line those lookaheads always pass, so the plain pattern can be
+        // used instead.
+        static bool hasCode(const std::string& line) {
+            return line.find('`') != std::string::npos || line.find("code>") != std::string::npos;
+        }
+}; // class LineParser
+class EmphasizedParser : public LineParser {
+    public:
+        void Parse(std::string& line) override {
+            // most lines have no markup, skip the regex for them
+            if (line.find('_') == std::string::npos) {
+                return;
+            }
+            static std::regex re("(?!.*`.*|.*<code>.*)_(?!.*`.*|.*<\\/code>.*)([^_]*)_(?!.*`.*|.*<\\/code>.*)");
+            static std::string replacement = "<em>$1</em>";
+            static std::regex plain("_([^_]*)_");
+            line = std::regex_replace(line, hasCode(line) ? re : plain, replacement);
+        }
+}; // class EmphasizedParser
+class ImageParser : public LineParser {
+    public:
+        void Parse(std::string& line) override {
+            // most lines have no markup, skip the regex for them
+            if (line.find("![") == std::string::npos) {
+                return;
+            }
+            static std::regex re("\\!\\[([^\\]]*)\\]\\(([^\\]]*)\\)");
+            static std::string replacement = "<img src=\"$2\" alt=\"$1\"/>";
+            line = std::regex_replace(line, re, replacement);
+        }
+}; // class ImageParser
+class InlineCodeParser : public LineParser {
+    public:
+        void Parse(std::string& line) override {
+            // most lines have no markup, skip the regex for them
+            if (line.find('`') == std::string::npos) {
+                return;
+            }
+            static std::regex re("`([^`]*)`");
+            static std::string replacement = "<code>$1</code>";
+            line = std::regex_replace(line, re, replacement);
+        }
+}; // class InlineCodeParser
+class ItalicParser : public LineParser {
+    public:
+        void Parse(std::string& line) override {
+            // most lines have no markup, skip the regex for them
+            if (line.find('*') == std::string::npos) {
+                return;
+            }
+            static std::regex re("(?!.*`.*|.*<code>.*)\\*(?!.*`.*|.*<\\/code>.*)([^\\*]*)\\*(?!.*`.*|.*<\\/code>.*)");
+            static std::string replacement = "<i>$1</i>";
+            static std::regex plain("\\*([^\\*]*)\\*");
+            line = std::regex_replace(line, hasCode(line) ? re : plain, replacement);
+        }
+}; // class ItalicParser
+class LinkParser : public LineParser {
+    public:
+        void Parse(std::string& line) override {
+            // most lines have no markup, skip the regex for them
+            if (line.find('[') == std::string::npos) {
+                return;
+            }
+            static std::regex re("\\[([^\\]]*)\\]\\(([^\\]]*)\\)");
+            static std::string replacement = "<a href=\"$2\">$1</a>";
+            line = std::regex_replace(line, re, replacement);
+        }
+}; // class LinkParser
+class StrikeThroughParser : public LineParser {
+    public:
+        void Parse(std::string& line) override {
+            // most lines have no markup, skip the regex for them
+            if (line.find("~~") == std::string::npos) {
+                return;
+            }
+            static std::regex re("(?!.*`.*|.*<code>.*)\\~\\~(?!.*`.*|.*<\\/code>.*)([^\\~]*)\\~\\~(?!.*`.*|.*<\\/code>.*)");
+            static std::string replacement = "<s>$1</s>";
+            static std::regex plain("\\~\\~([^\\~]*)\\~\\~");
+            line = std::regex_replace(line, hasCode(line) ? re : plain, replacement);
+        }
+}; // class StrikeThroughParser
+
+class StrongParser : public LineParser {
+    public:
+        void Parse(std::string& line) override {
+            // most lines have no markup, skip the regex for them
+            if (line.find("**") == std::string::npos && line.find("__") == std::string::npos) {
+                return;
+            }
+            static std::vector<std::regex> res {
+                std::regex{"(?!.*`.*|.*<code>.*)\\*\\*(?!.*`.*|.*<\\/code>.*)([^\\*\\*]*)\\*\\*(?!.*`.*|.*<\\/code>.*)"},
+                std::regex{"(?!.*`.*|.*<code>.*)__(?!.*`.*|.*<\\/code>.*)([^__]*)__(?!.*`.*|.*<\\/code>.*)"}
+            };
+            static std::string replacement = "<strong>$1</strong>";
+            static std::vector<std::regex> plain {
+                std::regex{"\\*\\*([^\\*\\*]*)\\*\\*"},
+                std::regex{"__([^__]*)__"}
+            };
+            for (const auto& re : hasCode(line) ? res : plain) {
+                line = std::regex_replace(line, re, replacement);
+            }
+        }
+}; // class StrongParser
+
 class ChecklistParser : public BlockParser {
     public:
         ChecklistParser(
@@ -177,14 +288,6 @@ class CodeBlockParser : public BlockParser {
         bool isStarted;
         bool isFinished;
 }; // class CodeBlockParser
-class EmphasizedParser : public LineParser {
-    public:
-        void Parse(std::string& line) override {
-            static std::regex re("(?!.*`.*|.*<code>.*)_(?!.*`.*|.*<\\/code>.*)([^_]*)_(?!.*`.*|.*<\\/code>.*)");
-            static std::string replacement = "<em>$1</em>";
-            line = std::regex_replace(line, re, replacement);
-        }
-}; // class EmphasizedParser
 class HeadlineParser : public BlockParser {
     public:
         HeadlineParser(
@@ -245,43 +348,6 @@ class HorizontalLineParser : public BlockParser {
     private:
         std::regex lineRegex;
 }; // class HorizontalLineParser
-class ImageParser : public LineParser {
-    public:
-        void Parse(std::string& line) override {
-            static std::regex re("\\!\\[([^\\]]*)\\]\\(([^\\]]*)\\)");
-            static std::string replacement = "<img src=\"$2\" alt=\"$1\"/>";
-            line = std::regex_replace(line, re, replacement);
-        }
-}; // class ImageParser
-class InlineCodeParser : public LineParser {
-    public:
-        void Parse(std::string& line) override {
-            static std::regex re("`([^`]*)`");
-            static std::string replacement = "<code>$1</code>";
-            line = std::regex_replace(line, re, replacement);
-        }
-}; // class InlineCodeParser
-class ItalicParser : public LineParser {
-    public:
-        void Parse(std::string& line) override {
-            std::regex re("(?!.*`.*|.*<code>.*)\\*(?!.*`.*|.*<\\/code>.*)([^\\*]*)\\*(?!.*`.*|.*<\\/code>.*)");
-            static std::string replacement = "<i>$1</i>";
-            line = std::regex_replace(line, re, replacement);
-        }
-}; // class ItalicParser
-class LineParser {
-    public:
-        virtual ~LineParser() {}
-        virtual void Parse(std::string& line) = 0;
-}; // class LineParser
-class LinkParser : public LineParser {
-    public:
-        void Parse(std::string& line) override {
-            static std::regex re("\\[([^\\]]*)\\]\\(([^\\]]*)\\)");
-            static std::string replacement = "<a href=\"$2\">$1</a>";
-            line = std::regex_replace(line, re, replacement);
-        }
-}; // class LinkParser
 class OrderedListParser : public BlockParser {
     public:
         OrderedListParser(
@@ -377,136 +443,6 @@ class ParagraphParser : public BlockParser {
         bool isStarted;
         bool isFinished;
 }; // class ParagraphParser
-class Parser {
-    public:
-        Parser() : emphasizedParser(std::make_shared<EmphasizedParser>())
-        , imageParser(std::make_shared<ImageParser>())
-        , inlineCodeParser(std::make_shared<InlineCodeParser>())
-        , italicParser(std::make_shared<ItalicParser>())
-        , linkParser(std::make_shared<LinkParser>())
-        , strikeThroughParser(std::make_shared<StrikeThroughParser>())
-        , strongParser(std::make_shared<StrongParser>())
-        {}
-        std::string Parse(std::stringstream& markdown) const {
-            std::string result = "";
-            std::shared_ptr<BlockParser> currentBlockParser = nullptr;
-            for (std::string line; std::getline(markdown, line);) {
-                if (!currentBlockParser) {
-                    currentBlockParser = getBlockParserForLine(line);
-                }
-                if (currentBlockParser) {
-                    currentBlockParser->AddLine(line);
-                    if (currentBlockParser->IsFinished()) {
-                        result += currentBlockParser->GetResult().str();
-                        currentBlockParser = nullptr;
-                    }
-                }
-            }
-            // make sure, that all parsers are finished
-            if (currentBlockParser) {
-                std::string emptyLine = "";
-                currentBlockParser->AddLine(emptyLine);
-                if (currentBlockParser->IsFinished()) {
-                    result += currentBlockParser->GetResult().str();
-                    currentBlockParser = nullptr;
-                }
-            }
-            return result;
-        }
-    private:
-        std::shared_ptr<EmphasizedParser> emphasizedParser;
-        std::shared_ptr<ImageParser> imageParser;
-        std::shared_ptr<InlineCodeParser> inlineCodeParser;
-        std::shared_ptr<ItalicParser> italicParser;
-        std::shared_ptr<LinkParser> linkParser;
-        std::shared_ptr<StrikeThroughParser> strikeThroughParser;
-        std::shared_ptr<StrongParser> strongParser;
-        // block parser have to run before
-        void runLineParser(std::string& line) const {
-            // Attention! ImageParser has to be before LinkParser
-            this->imageParser->Parse(line);
-            this->linkParser->Parse(line);
-            // Attention! StrongParser has to be before EmphasizedParser
-            this->strongParser->Parse(line);
-            this->emphasizedParser->Parse(line);
-            this->strikeThroughParser->Parse(line);
-            this->inlineCodeParser->Parse(line);
-            this->italicParser->Parse(line);
-        }
-        std::shared_ptr<BlockParser> getBlockParserForLine(const std::string& line) const {
-            std::shared_ptr<BlockParser> parser;
-            if (CodeBlockParser::IsStartingLine(line)) {
-                parser = std::make_shared<CodeBlockParser>( nullptr, nullptr );
-            } else if (HeadlineParser::IsStartingLine(line)) {
-                parser = std::make_shared<HeadlineParser>( nullptr, nullptr );
-            } else if (HorizontalLineParser::IsStartingLine(line)) {
-                parser = std::make_shared<HorizontalLineParser>( nullptr, nullptr );
-            } else if (QuoteParser::IsStartingLine(line)) {
-                parser = std::make_shared<QuoteParser>(
-                    [this](std::string& line){ this->runLineParser(line); },
-                    [this](const std::string& line){ return this->getBlockParserForLine(line); }
-                );
-            } else if (TableParser::IsStartingLine(line)) {
-                parser = std::make_shared<TableParser>(
-                    [this](std::string& line){ this->runLineParser(line); },
-                    nullptr
-                );
-            } else if (ChecklistParser::IsStartingLine(line)) {
-                parser = this->createChecklistParser();
-            } else if (OrderedListParser::IsStartingLine(line)) {
-                parser = this->createOrderedListParser();
-            } else if (UnorderedListParser::IsStartingLine(line)) {
-                parser = this->createUnorderedListParser();
-            } else if (ParagraphParser::IsStartingLine(line)) {
-                parser = std::make_shared<ParagraphParser>(
-                    [this](std::string& line){ this->runLineParser(line); },
-                    nullptr
-                );
-            }
-            return parser;
-        }
-        std::shared_ptr<BlockParser> createChecklistParser() const {
-            return std::make_shared<ChecklistParser>(
-                [this](std::string& line){ this->runLineParser(line); },
-                [this](const std::string& line) {
-                    std::shared_ptr<BlockParser> parser;
-                    if (ChecklistParser::IsStartingLine(line)) {
-                        parser = this->createChecklistParser();
-                    }
-                    return parser;
-                }
-            );
-        }
-        std::shared_ptr<BlockParser> createOrderedListParser() const {
-            return std::make_shared<OrderedListParser>(
-                [this](std::string& line){ this->runLineParser(line); },
-                [this](const std::string& line) {
-                    std::shared_ptr<BlockParser> parser;
-                    if (OrderedListParser::IsStartingLine(line)) {
-                        parser = this->createOrderedListParser();
-                    } else if (UnorderedListParser::IsStartingLine(line)) {
-                        parser = this->createUnorderedListParser();
-                    }
-                    return parser;
-                }
-            );
-        }
-        std::shared_ptr<BlockParser> createUnorderedListParser() const {
-            return std::make_shared<UnorderedListParser>(
-                [this](std::string& line){ this->runLineParser(line); },
-                [this](const std::string& line) {
-                    std::shared_ptr<BlockParser> parser;
-                    if (OrderedListParser::IsStartingLine(line)) {
-                        parser = this->createOrderedListParser();
-                    } else if (UnorderedListParser::IsStartingLine(line)) {
-                        parser = this->createUnorderedListParser();
-                    }
-                    return parser;
-                }
-            );
-        }
-}; // class Parser
-
 class QuoteParser : public BlockParser {
     public:
         QuoteParser(
@@ -569,29 +505,6 @@ class QuoteParser : public BlockParser {
         bool isFinished;
 }; // class QuoteParser
 
-class StrikeThroughParser : public LineParser {
-    public:
-        void Parse(std::string& line) override {
-            static std::regex re("(?!.*`.*|.*<code>.*)\\~\\~(?!.*`.*|.*<\\/code>.*)([^\\~]*)\\~\\~(?!.*`.*|.*<\\/code>.*)");
-            static std::string replacement = "<s>$1</s>";
-            line = std::regex_replace(line, re, replacement);
-        }
-}; // class StrikeThroughParser
-
-class StrongParser : public LineParser {
-    public:
-        void Parse(std::string& line) override {
-            static std::vector<std::regex> res {
-                std::regex{"(?!.*`.*|.*<code>.*)\\*\\*(?!.*`.*|.*<\\/code>.*)([^\\*\\*]*)\\*\\*(?!.*`.*|.*<\\/code>.*)"},
-                std::regex{"(?!.*`.*|.*<code>.*)__(?!.*`.*|.*<\\/code>.*)([^__]*)__(?!.*`.*|.*<\\/code>.*)"}
-            };
-            static std::string replacement = "<strong>$1</strong>";
-            for (const auto& re : res) {
-                line = std::regex_replace(line, re, replacement);
-            }
-        }
-}; // class StrongParser
-
 class TableParser : public BlockParser {
     public:
         TableParser(
@@ -754,4 +667,134 @@ class UnorderedListParser : public BlockParser {
         bool isFinished;
 }; // class UnorderedListParser
 
+class Parser {
+    public:
+        Parser() : emphasizedParser(std::make_shared<EmphasizedParser>())
+        , imageParser(std::make_shared<ImageParser>())
+        , inlineCodeParser(std::make_shared<InlineCodeParser>())
+        , italicParser(std::make_shared<ItalicParser>())
+        , linkParser(std::make_shared<LinkParser>())
+        , strikeThroughParser(std::make_shared<StrikeThroughParser>())
+        , strongParser(std::make_shared<StrongParser>())
+        {}
+        std::string Parse(std::stringstream& markdown) const {
+            std::string result = "";
+            std::shared_ptr<BlockParser> currentBlockParser = nullptr;
+            for (std::string line; std::getline(markdown, line);) {
+                if (!currentBlockParser) {
+                    currentBlockParser = getBlockParserForLine(line);
+                }
+                if (currentBlockParser) {
+                    currentBlockParser->AddLine(line);
+                    if (currentBlockParser->IsFinished()) {
+                        result += currentBlockParser->GetResult().str();
+                        currentBlockParser = nullptr;
+                    }
+                }
+            }
+            // make sure, that all parsers are finished
+            if (currentBlockParser) {
+                std::string emptyLine = "";
+                currentBlockParser->AddLine(emptyLine);
+                if (currentBlockParser->IsFinished()) {
+                    result += currentBlockParser->GetResult().str();
+                    currentBlockParser = nullptr;
+                }
+            }
+            return result;
+        }
+    private:
+        std::shared_ptr<EmphasizedParser> emphasizedParser;
+        std::shared_ptr<ImageParser> imageParser;
+        std::shared_ptr<InlineCodeParser> inlineCodeParser;
+        std::shared_ptr<ItalicParser> italicParser;
+        std::shared_ptr<LinkParser> linkParser;
+        std::shared_ptr<StrikeThroughParser> strikeThroughParser;
+        std::shared_ptr<StrongParser> strongParser;
+        // block parser have to run before
+        void runLineParser(std::string& line) const {
+            // Attention! ImageParser has to be before LinkParser
+            this->imageParser->Parse(line);
+            this->linkParser->Parse(line);
+            // Attention! StrongParser has to be before EmphasizedParser
+            this->strongParser->Parse(line);
+            this->emphasizedParser->Parse(line);
+            this->strikeThroughParser->Parse(line);
+            this->inlineCodeParser->Parse(line);
+            this->italicParser->Parse(line);
+        }
+        std::shared_ptr<BlockParser> getBlockParserForLine(const std::string& line) const {
+            std::shared_ptr<BlockParser> parser;
+            if (CodeBlockParser::IsStartingLine(line)) {
+                parser = std::make_shared<CodeBlockParser>( nullptr, nullptr );
+            } else if (HeadlineParser::IsStartingLine(line)) {
+                parser = std::make_shared<HeadlineParser>( nullptr, nullptr );
+            } else if (HorizontalLineParser::IsStartingLine(line)) {
+                parser = std::make_shared<HorizontalLineParser>( nullptr, nullptr );
+            } else if (QuoteParser::IsStartingLine(line)) {
+                parser = std::make_shared<QuoteParser>(
+                    [this](std::string& line){ this->runLineParser(line); },
+                    [this](const std::string& line){ return this->getBlockParserForLine(line); }
+                );
+            } else if (TableParser::IsStartingLine(line)) {
+                parser = std::make_shared<TableParser>(
+                    [this](std::string& line){ this->runLineParser(line); },
+                    nullptr
+                );
+            } else if (ChecklistParser::IsStartingLine(line)) {
+                parser = this->createChecklistParser();
+            } else if (OrderedListParser::IsStartingLine(line)) {
+                parser = this->createOrderedListParser();
+            } else if (UnorderedListParser::IsStartingLine(line)) {
+                parser = this->createUnorderedListParser();
+            } else if (ParagraphParser::IsStartingLine(line)) {
+                parser = std::make_shared<ParagraphParser>(
+                    [this](std::string& line){ this->runLineParser(line); },
+                    nullptr
+                );
+            }
+            return parser;
+        }
+        std::shared_ptr<BlockParser> createChecklistParser() const {
+            return std::make_shared<ChecklistParser>(
+                [this](std::string& line){ this->runLineParser(line); },
+                [this](const std::string& line) {
+                    std::shared_ptr<BlockParser> parser;
+                    if (ChecklistParser::IsStartingLine(line)) {
+                        parser = this->createChecklistParser();
+                    }
+                    return parser;
+                }
+            );
+        }
+        std::shared_ptr<BlockParser> createOrderedListParser() const {
+            return std::make_shared<OrderedListParser>(
+                [this](std::string& line){ this->runLineParser(line); },
+                [this](const std::string& line) {
+                    std::shared_ptr<BlockParser> parser;
+                    if (OrderedListParser::IsStartingLine(line)) {
+                        parser = this->createOrderedListParser();
+                    } else if (UnorderedListParser::IsStartingLine(line)) {
+                        parser = this->createUnorderedListParser();
+                    }
+                    return parser;
+                }
+            );
+        }
+        std::shared_ptr<BlockParser> createUnorderedListParser() const {
+            return std::make_shared<UnorderedListParser>(
+                [this](std::string& line){ this->runLineParser(line); },
+                [this](const std::string& line) {
+                    std::shared_ptr<BlockParser> parser;
+                    if (OrderedListParser::IsStartingLine(line)) {
+                        parser = this->createOrderedListParser();
+                    } else if (UnorderedListParser::IsStartingLine(line)) {
+                        parser = this->createUnorderedListParser();
+                    }
+                    return parser;
+                }
+            );
+        }
+}; // class Parser
+
 #endif
\ No newline at end of file
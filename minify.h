@@ -0,0 +1,172 @@
+#ifndef _MINIFY_H
+#define _MINIFY_H
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+// Streaming HTML minifier. Input can be fed in chunks of any size, the
+// state carries over between calls. Whitespace runs in text collapse to a
+// single space and disappear entirely next to block-level tags; the
+// content of <pre>, <code> and <textarea> is copied verbatim, as is the
+// raw text of <script> and <style>. Tags themselves are not rewritten.
+class html_minifier {
+    public:
+        html_minifier() : state(STATE_TEXT), quote(0), pending_space(false), after_block(true), preserve(0), raw_match(0) {}
+        void write(const char *s, size_t n, std::string &out) {
+            for (size_t i = 0; i < n; i++) {
+                put(s[i], out);
+            }
+        }
+        void finish(std::string &out) {
+            if (state == STATE_TAG) {
+                // unterminated tag, keep what was seen
+                out += tag;
+                tag.clear();
+            }
+            state = STATE_TEXT;
+        }
+    private:
+        enum state_t {
+            STATE_TEXT,
+            STATE_TAG,
+            STATE_RAW,
+            STATE_RAW_CLOSE
+        };
+        state_t state;
+        char quote;
+        bool pending_space, after_block;
+        int preserve;
+        size_t raw_match;
+        std::string tag, raw_end;
+
+        static bool is_space(char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+        }
+        // Lowercased element name of a tag such as "<p class=x>" or "</p>".
+        static std::string tag_name(const std::string &tag, bool &closing) {
+            size_t i = 1;
+            closing = tag.size() > 1 && tag[1] == '/';
+            if (closing) {
+                i++;
+            }
+            std::string name;
+            for (; i < tag.size() && (isalnum((unsigned char)tag[i]) || tag[i] == '!'); i++) {
+                name += tolower((unsigned char)tag[i]);
+            }
+            return name;
+        }
+        static bool is_block(const std::string &name) {
+            static const char *blocks[] = {
+                "!doctype", "html", "head", "body", "title", "meta", "link", "style", "script",
+                "div", "p", "h1", "h2", "h3", "h4", "h5", "h6", "ul", "ol", "li", "dl", "dt", "dd",
+                "table", "thead", "tbody", "tfoot", "tr", "td", "th", "caption", "blockquote", "pre",
+                "hr", "br", "section", "article", "header", "footer", "nav", "main", "aside",
+                "figure", "figcaption", "form", "fieldset", "noscript", NULL
+            };
+            for (int i = 0; blocks[i] != NULL; i++) {
+                if (name == blocks[i]) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        static bool is_preserved(const std::string &name) {
+            return name == "pre" || name == "code" || name == "textarea";
+        }
+        void end_tag(std::string &out) {
+            bool closing = false;
+            std::string name = tag_name(tag, closing);
+            bool block = is_block(name);
+            if (pending_space && ! block && ! after_block) {
+                out += ' ';
+            }
+            pending_space = false;
+            out += tag;
+            tag.clear();
+            after_block = block;
+            state = STATE_TEXT;
+            if (is_preserved(name)) {
+                preserve += closing ? -1 : 1;
+                if (preserve < 0) {
+                    preserve = 0;
+                }
+            } else if ( ! closing && (name == "script" || name == "style")) {
+                raw_end = "</" + name;
+                raw_match = 0;
+                state = STATE_RAW;
+            }
+        }
+        void put(char c, std::string &out) {
+            switch (state) {
+                case STATE_TAG:
+                    tag += c;
+                    if (quote) {
+                        if (c == quote) {
+                            quote = 0;
+                        }
+                    } else if (c == '"' || c == '\'') {
+                        quote = c;
+                    } else if (c == '>') {
+                        end_tag(out);
+                    }
+                    return;
+                case STATE_RAW:
+                    out += c;
+                    if (tolower((unsigned char)c) == raw_end[raw_match]) {
+                        if (++raw_match == raw_end.size()) {
+                            state = STATE_RAW_CLOSE;
+                        }
+                    } else {
+                        raw_match = tolower((unsigned char)c) == raw_end[0] ? 1 : 0;
+                    }
+                    return;
+                case STATE_RAW_CLOSE:
+                    out += c;
+                    if (c == '>') {
+                        state = STATE_TEXT;
+                        after_block = true;
+                    }
+                    return;
+                default:
+                    break;
+            }
+            if (c == '<') {
+                state = STATE_TAG;
+                quote = 0;
+                tag = "<";
+                return;
+            }
+            if (preserve > 0) {
+                if (pending_space) {
+                    out += ' ';
+                    pending_space = false;
+                }
+                out += c;
+                after_block = false;
+                return;
+            }
+            if (is_space(c)) {
+                pending_space = true;
+                return;
+            }
+            if (pending_space && ! after_block) {
+                out += ' ';
+            }
+            pending_space = false;
+            after_block = false;
+            out += c;
+        }
+};
+
+std::string minify_html(const std::string &html) {
+    std::string out;
+    out.reserve(html.size());
+    html_minifier minifier;
+    minifier.write(html.data(), html.size(), out);
+    minifier.finish(out);
+    return out;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Startup profile of a CGI invocation. With CPPBLOG_PROFILE set, main()
+// and handle_request() mark the end of each phase; the microseconds spent
+// in each go out as a Server-Timing header (the phases before the head is
+// sent) and as one line on stderr, which the gateway logs. The first
+// phase runs from the constructor below, after the dynamic loader, to
+// main(): the static initialisation of this program.
+typedef struct {
+    const char *name;
+    double us;
+} profile_phase_t;
+
+bool profile_enabled = false;
+double profile_origin = 0, profile_last = 0;
+std::vector<profile_phase_t> profile_phases;
+
+double profile_clock_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+__attribute__((constructor(101))) void profile_start() {
+    profile_origin = profile_last = profile_clock_us();
+}
+
+void profile_mark(const char *name) {
+    if ( ! profile_enabled) {
+        return;
+    }
+    double now = profile_clock_us();
+    profile_phase_t phase = { name, now - profile_last };
+    profile_phases.push_back(phase);
+    profile_last = now;
+}
+// "exepath;dur=0.004, open;dur=0.120" (milliseconds)
+std::string profile_server_timing() {
+    std::string value;
+    char buff[64];
+    for (auto phase = profile_phases.begin(); phase != profile_phases.end(); ++phase) {
+        snprintf(buff, sizeof(buff), "%s%s;dur=%.3f", value.empty() ? "" : ", ", phase->name, phase->us / 1000);
+        value += buff;
+    }
+    return value;
+}
+
+void profile_report(const char *uri) {
+    if ( ! profile_enabled) {
+        return;
+    }
+    std::cerr << "startup " << (uri != NULL ? uri : "-") << ":";
+    for (auto phase = profile_phases.begin(); phase != profile_phases.end(); ++phase) {
+        std::cerr << " " << phase->name << "=" << (long long)(phase->us + 0.5) << "us";
+    }
+    std::cerr << " total=" << (long long)(profile_clock_us() - profile_origin + 0.5) << "us" << std::endl;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef _PURGE_H
+#define _PURGE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "util.h"
+#include "md5.h"
+#include "config.h"
+#include "cache.h"
+#include "archive.h"
+#include "sitemap.h"
+#include "sqlite3.h"
+
+void replace_all(std::string &str, const std::string &from, const std::string &to) {
+    size_t pos = 0;
+    while ((pos = str.find(from, pos)) != std::string::npos) {
+        str.replace(pos, from.size(), to);
+        pos += to.size();
+    }
+}
+// Builds the fastcgi_cache_key nginx computes for a GET of uri, using the
+// variables cppblog.conf puts in the key.
+std::string nginx_cache_key(const std::string &uri, const std::string &encoding) {
+    std::string scheme = "http", host = config.domain;
+    size_t sep = host.find("://");
+    if (sep != std::string::npos) {
+        scheme = host.substr(0, sep);
+        host = host.substr(sep + 3);
+    }
+    host = host.substr(0, host.find('/'));
+    std::string key = config.nginx_cache_key;
+    replace_all(key, "$scheme", scheme);
+    replace_all(key, "$request_method", "GET");
+    replace_all(key, "$host", host);
+    replace_all(key, "$request_uri", uri);
+    replace_all(key, "$cppblog_encoding", encoding);
+    return key;
+}
+// nginx names an entry by the md5 of its key, and with levels=1:2 nests it
+// as <path>/<last char>/<two chars before that>/<md5>.
+std::string nginx_cache_file(const std::string &key) {
+    std::string md5 = md5_hex(key);
+    std::string path = config.nginx_cache_path;
+    rtrim(path, "/");
+    size_t end = md5.size();
+    const char *levels = config.nginx_cache_levels.c_str();
+    while (*levels) {
+        int n = atoi(levels);
+        if (n < 1 || n > 2) {
+            break;
+        }
+        end -= n;
+        path += PATH_SEPARATOR + md5.substr(end, n);
+        levels = strchr(levels, ':');
+        if (levels == NULL) {
+            break;
+        }
+        levels++;
+    }
+    return path + PATH_SEPARATOR + md5;
+}
+// Drops uris from the output cache and, when configured, from nginx's
+// fastcgi_cache for every Accept-Encoding variant cppblog.conf keys on.
+// Returns how many nginx entries were removed.
+int purge_urls(const std::vector<std::string> &urls, const std::string &cacheDir) {
+    static const char *encodings[] = { "", "gzip", "br" };
+    int removed = 0;
+    for (auto url = urls.begin(); url != urls.end(); ++url) {
+        page_purge(cacheDir, *url);
+        if (config.nginx_cache_path.empty()) {
+            continue;
+        }
+        for (int i = 0; i < 3; i++) {
+            if (remove(nginx_cache_file(nginx_cache_key(*url, encodings[i])).c_str()) == 0) {
+                removed++;
+            }
+        }
+    }
+    return removed;
+}
+// Terms do not record whether they are tags or categories yet, so both
+// listings and both feeds are purged.
+std::vector<std::string> term_urls(const std::string &slug) {
+    std::vector<std::string> urls;
+    urls.push_back("/tu-khoa/" + encode_url(slug) + "/");
+    urls.push_back("/chuyen-muc/" + encode_url(slug) + "/");
+    urls.push_back("/tu-khoa/" + encode_url(slug) + "/feed/");
+    urls.push_back("/chuyen-muc/" + encode_url(slug) + "/feed/");
+    return urls;
+}
+// Every page that shows a post: its own pages, the homepage and the site
+// feed, its month's archive, the listings and feeds of its terms and the
+// sitemaps that list them. Must run before a delete, while
+// the post_terms rows still exist.
+std::vector<std::string> post_urls(sqlite3 *db, const std::string &slug) {
+    std::vector<std::string> urls;
+    urls.push_back("/");
+    urls.push_back("/feed/");
+    urls.push_back("/" + encode_url(slug) + "/");
+    urls.push_back("/" + encode_url(slug) + "/amp/");
+    urls.push_back("/sitemap.xml");
+    urls.push_back("/sitemap-pages.xml");
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT pubtime, id FROM posts WHERE slug = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, slug.c_str(), slug.size(), SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            if (sqlite3_column_int64(stmt, 0) > 0) {
+                urls.push_back(archive_url(pubtime_month(sqlite3_column_int64(stmt, 0))));
+            }
+            urls.push_back(sitemap_shard_url(SITEMAP_POSTS, (sqlite3_column_int64(stmt, 1) - 1) / sitemap_shard + 1));
+        }
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT t.slug, t.id FROM posts p JOIN post_terms pt ON pt.post_id = p.id JOIN terms t ON t.id = pt.term_id WHERE p.slug = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return urls;
+    }
+    sqlite3_bind_text(stmt, 1, slug.c_str(), slug.size(), SQLITE_STATIC);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        std::vector<std::string> terms = term_urls((const char*)sqlite3_column_text(stmt, 0));
+        urls.insert(urls.end(), terms.begin(), terms.end());
+        std::string shard = sitemap_shard_url(SITEMAP_TERMS, (sqlite3_column_int64(stmt, 1) - 1) / sitemap_shard + 1);
+        if (std::find(urls.begin(), urls.end(), shard) == urls.end()) {
+            urls.push_back(shard);
+        }
+    }
+    sqlite3_finalize(stmt);
+    return urls;
+}
+
+#endif
@@ -2,13 +2,16 @@ drop table if exists post_terms;
 create table if not exists post_terms (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
     post_id INTEGER NOT NULL DEFAULT 0,
-    term_id INTEGER NOT NULL DEFAULT 0
+    term_id INTEGER NOT NULL DEFAULT 0,
+    pubdate TEXT NOT NULL DEFAULT '',
+    pubtime INTEGER NOT NULL DEFAULT 0
 );
 drop table if exists terms;
 create table if not exists terms (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
     name TEXT NOT NULL,
-    slug TEXT NOT NULL
+    slug TEXT NOT NULL,
+    post_count INTEGER NOT NULL DEFAULT 0
 );
 drop table if exists posts;
 create table if not exists posts (
@@ -18,5 +21,66 @@ create table if not exists posts (
     excerpt TEXT NOT NULL,
     content TEXT NOT NULL,
     pubdate TEXT NOT NULL,
-    tags TEXT NOT NULL
+    tags TEXT NOT NULL,
+    pubtime INTEGER NOT NULL DEFAULT 0
+);
+drop table if exists archive_months;
+create table if not exists archive_months (
+    month INTEGER PRIMARY KEY,
+    post_count INTEGER NOT NULL DEFAULT 0
 );
+create unique index if not exists posts_slug on posts (slug);
+create index if not exists terms_slug on terms (slug);
+create index if not exists posts_pubtime on posts (pubtime, id);
+create index if not exists post_terms_listing on post_terms (term_id, pubtime, post_id);
+create index if not exists post_terms_post on post_terms (post_id);
+create trigger if not exists posts_pubtime_insert after insert on posts
+    when new.pubtime is not coalesce(cast(strftime('%s', new.pubdate) as integer), 0) begin
+    update posts set pubtime = coalesce(cast(strftime('%s', new.pubdate) as integer), 0) where id = new.id;
+end;
+create trigger if not exists post_terms_pubdate after insert on post_terms begin
+    update post_terms set pubdate = coalesce((select pubdate from posts where id = new.post_id), ''),
+        pubtime = coalesce((select pubtime from posts where id = new.post_id), 0) where id = new.id;
+end;
+create trigger if not exists posts_pubdate_update after update of pubdate on posts begin
+    update posts set pubtime = coalesce(cast(strftime('%s', new.pubdate) as integer), 0) where id = new.id;
+    update post_terms set pubdate = new.pubdate, pubtime = (select pubtime from posts where id = new.id) where post_id = new.id;
+    update archive_months set post_count = post_count - 1 where month = coalesce(cast(strftime('%Y%m', old.pubdate) as integer), 0);
+    insert into archive_months (month, post_count) values (coalesce(cast(strftime('%Y%m', new.pubdate) as integer), 0), 1)
+        on conflict (month) do update set post_count = post_count + 1;
+end;
+create trigger if not exists posts_month_insert after insert on posts begin
+    insert into archive_months (month, post_count) values (coalesce(cast(strftime('%Y%m', new.pubdate) as integer), 0), 1)
+        on conflict (month) do update set post_count = post_count + 1;
+end;
+create trigger if not exists posts_month_delete after delete on posts begin
+    update archive_months set post_count = post_count - 1 where month = coalesce(cast(strftime('%Y%m', old.pubdate) as integer), 0);
+end;
+create index if not exists terms_listing on terms (name, slug, post_count);
+create trigger if not exists post_terms_count_insert after insert on post_terms begin
+    update terms set post_count = post_count + 1 where id = new.term_id;
+end;
+create trigger if not exists post_terms_count_delete after delete on post_terms begin
+    update terms set post_count = post_count - 1 where id = old.term_id;
+end;
+create trigger if not exists post_terms_count_update after update of term_id on post_terms begin
+    update terms set post_count = post_count - 1 where id = old.term_id;
+    update terms set post_count = post_count + 1 where id = new.term_id;
+end;
+create trigger if not exists posts_terms_delete after delete on posts begin
+    delete from post_terms where post_id = old.id;
+end;
+drop table if exists posts_fts;
+-- tokenize='vietnamese' is registered by cppblog.cgi (search.h)
+create virtual table if not exists posts_fts using fts5(title, excerpt, content, content='posts', content_rowid='id', tokenize='vietnamese');
+create trigger if not exists posts_fts_insert after insert on posts begin
+    insert into posts_fts (rowid, title, excerpt, content) values (new.id, new.title, new.excerpt, new.content);
+end;
+create trigger if not exists posts_fts_delete after delete on posts begin
+    insert into posts_fts (posts_fts, rowid, title, excerpt, content) values ('delete', old.id, old.title, old.excerpt, old.content);
+end;
+create trigger if not exists posts_fts_update after update of title, excerpt, content on posts begin
+    insert into posts_fts (posts_fts, rowid, title, excerpt, content) values ('delete', old.id, old.title, old.excerpt, old.content);
+    insert into posts_fts (rowid, title, excerpt, content) values (new.id, new.title, new.excerpt, new.content);
+end;
+insert into posts_fts (posts_fts, rank) values ('rank', 'bm25(10.0, 5.0, 1.0)');
@@ -0,0 +1,243 @@
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "sqlite3.h"
+#include "html.h"
+#include "entry.h"
+#include "util.h"
+#include "fold.h"
+
+typedef struct {
+    sqlite3_int64 id;
+    double rank;
+    std::string slug, title, snippet;
+} search_hit_t;
+
+// FTS5 tokenizer "vietnamese": words are split and accent-folded through
+// the fold.h tables while indexing and while parsing queries, so "tu khoa"
+// matches "từ khóa" without any per-row work at query time. Offsets given
+// to FTS5 point into the original text so snippet() highlights it intact.
+int vietnamese_create(void *ctx, const char **argv, int argc, Fts5Tokenizer **out) {
+    // stateless, but FTS5 wants a non-NULL handle
+    static char instance;
+    *out = (Fts5Tokenizer *)&instance;
+    return SQLITE_OK;
+}
+
+void vietnamese_delete(Fts5Tokenizer *tokenizer) {
+}
+
+int vietnamese_tokenize(Fts5Tokenizer *tokenizer, void *ctx, int flags, const char *text, int len,
+        int (*token)(void *ctx, int flags, const char *token, int len, int start, int end)) {
+    const unsigned char *s = (const unsigned char *)text;
+    char word[256];
+    int word_len = 0, start = 0, i = 0;
+    while (i <= len) {
+        char folded = FOLD_SEP;
+        int n = 1;
+        if (i < len) {
+            n = fold_codepoint(s + i, len - i, folded);
+        }
+        if (folded == FOLD_SEP) {
+            if (word_len > 0) {
+                int rc = token(ctx, 0, word, word_len, start, i);
+                if (rc != SQLITE_OK) {
+                    return rc;
+                }
+                word_len = 0;
+            }
+        } else if (folded != FOLD_DROP) {
+            if (word_len == 0) {
+                start = i;
+            }
+            // overlong words are cut, FTS5 would not match them anyway
+            if (folded == FOLD_KEEP) {
+                if (word_len + n <= (int)sizeof(word)) {
+                    memcpy(word + word_len, text + i, n);
+                    word_len += n;
+                }
+            } else if (word_len < (int)sizeof(word)) {
+                word[word_len++] = folded;
+            }
+        }
+        i += n;
+    }
+    return SQLITE_OK;
+}
+// Must run on every connection before posts_fts is read or written,
+// including through the triggers on posts.
+bool register_search_tokenizer(sqlite3 *db) {
+    fts5_api *api = NULL;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT fts5(?1);", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_pointer(stmt, 1, (void *)&api, "fts5_api_ptr", NULL);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (api == NULL) {
+        return false;
+    }
+    static fts5_tokenizer tokenizer = { vietnamese_create, vietnamese_delete, vietnamese_tokenize };
+    return api->xCreateTokenizer(api, "vietnamese", NULL, &tokenizer, NULL) == SQLITE_OK;
+}
+// Rebuilds posts_fts from posts and reports the indexing throughput.
+bool reindex_posts(sqlite3 *db) {
+    sqlite3_stmt *stmt = NULL;
+    long long rows = 0, bytes = 0;
+    if (sqlite3_prepare_v2(db, "SELECT count(*), sum(length(CAST(title AS BLOB)) + length(CAST(excerpt AS BLOB)) + length(CAST(content AS BLOB))) FROM posts;", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        rows = sqlite3_column_int64(stmt, 0);
+        bytes = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    double start = now_ms();
+    char *zErrMsg = 0;
+    if (sqlite3_exec(db, "INSERT INTO posts_fts (posts_fts) VALUES ('rebuild');", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        std::cout << "SQL error rebuilding search index: " << zErrMsg << std::endl;
+        sqlite3_free(zErrMsg);
+        return false;
+    }
+    double ms = now_ms() - start;
+    double secs = ms > 0 ? ms / 1000 : 0.001;
+    std::cout << "Indexed " << rows << " posts (" << bytes << " bytes) in " << ms << " ms: "
+        << (long long)(rows / secs) << " posts/s, " << bytes / secs / 1048576 << " MB/s" << std::endl;
+    return true;
+}
+// Turns what a reader typed into an FTS5 query: every word becomes a
+// quoted string, so operators and stray quotes are matched literally and
+// all words are required.
+std::string fts_query(const std::string &q) {
+    std::string query, word;
+    for (size_t i = 0; i <= q.size(); i++) {
+        char c = i < q.size() ? q[i] : ' ';
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            if ( ! word.empty()) {
+                query += (query.empty() ? "\"" : " \"") + word + "\"";
+                word.clear();
+            }
+        } else if (c == '"') {
+            word += "\"\"";
+        } else {
+            word += c;
+        }
+    }
+    return query;
+}
+// Results are ordered by (rank, id). A cursor is the pair of the last hit
+// shown, written with enough digits to round-trip the bm25 double.
+std::string search_cursor(const search_hit_t &hit) {
+    char buff[64];
+    snprintf(buff, sizeof(buff), "%.17g:%lld", hit.rank, (long long)hit.id);
+    return buff;
+}
+
+bool parse_search_cursor(const std::string &cursor, double &rank, sqlite3_int64 &id) {
+    size_t sep = cursor.rfind(':');
+    if (sep == std::string::npos) {
+        return false;
+    }
+    char *end = NULL;
+    rank = strtod(cursor.c_str(), &end);
+    if (end != cursor.c_str() + sep) {
+        return false;
+    }
+    id = strtoll(cursor.c_str() + sep + 1, &end, 10);
+    return *end == '\0';
+}
+// One page of hits after cursor (or the first page when it is empty),
+// best first. bm25 weights are stored in the index's rank setting.
+bool search_posts(sqlite3 *db, const std::string &q, const std::string &cursor, int limit, std::vector<search_hit_t> &hits) {
+    std::string match = fts_query(q);
+    if (match.empty()) {
+        return true;
+    }
+    double after_rank = 0;
+    sqlite3_int64 after_id = 0;
+    bool paged = parse_search_cursor(cursor, after_rank, after_id);
+    std::string sql = "SELECT p.id, posts_fts.rank, p.slug, p.title, snippet(posts_fts, -1, char(1), char(2), '...', 24) FROM posts_fts JOIN posts p ON p.id = posts_fts.rowid WHERE posts_fts MATCH ?1";
+    if (paged) {
+        sql += " AND (posts_fts.rank > ?2 OR (posts_fts.rank = ?2 AND posts_fts.rowid > ?3))";
+    }
+    sql += " ORDER BY posts_fts.rank, posts_fts.rowid LIMIT ?4;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, match.c_str(), match.size(), SQLITE_STATIC);
+    if (paged) {
+        sqlite3_bind_double(stmt, 2, after_rank);
+        sqlite3_bind_int64(stmt, 3, after_id);
+    }
+    sqlite3_bind_int(stmt, 4, limit);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        search_hit_t hit;
+        hit.id = sqlite3_column_int64(stmt, 0);
+        hit.rank = sqlite3_column_double(stmt, 1);
+        hit.slug = (const char*)sqlite3_column_text(stmt, 2);
+        hit.title = (const char*)sqlite3_column_text(stmt, 3);
+        const char *snippet = (const char*)sqlite3_column_text(stmt, 4);
+        hit.snippet = snippet != NULL ? snippet : "";
+        hits.push_back(hit);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+// Escapes the snippet and only then turns the match markers into <mark>,
+// so stored text can never inject markup.
+std::string snippet_html(const std::string &snippet) {
+    std::string html = htmlspecialchars(snippet), out;
+    for (size_t i = 0; i < html.size(); i++) {
+        if (html[i] == '\x01') {
+            out += "<mark>";
+        } else if (html[i] == '\x02') {
+            out += "</mark>";
+        } else {
+            out += html[i];
+        }
+    }
+    return out;
+}
+
+void render_search(sqlite3 *db, const std::string &q, const std::string &cursor) {
+    const int per_page = 10;
+    search_form(q);
+    if (q.empty()) {
+        return;
+    }
+    std::vector<search_hit_t> hits;
+    // one extra row tells whether an older page exists
+    if ( ! search_posts(db, q, cursor, per_page + 1, hits)) {
+        p_tag("Search failed");
+        return;
+    }
+    if (hits.empty()) {
+        p_tag("No posts found for " + htmlspecialchars(q));
+        return;
+    }
+    bool more = hits.size() > (size_t)per_page;
+    if (more) {
+        hits.pop_back();
+    }
+    std::string html;
+    for (auto hit = hits.begin(); hit != hits.end(); ++hit) {
+        html.assign("<article><h3><a href=\"");
+        the_entry_url(hit->slug, "", html);
+        html += "\">";
+        htmlspecialchars_to(hit->title, html);
+        html += "</a></h3><p>";
+        std::cout.write(html.data(), html.size());
+        std::cout << snippet_html(hit->snippet) << "</p></article>";
+    }
+    if (more) {
+        std::cout << "<nav><a href=\"/tim-kiem?q=" << encode_url_component(q) << "&amp;after=" << encode_url_component(search_cursor(hits.back())) << "\" rel=\"next\">More results</a></nav>";
+    }
+}
+
+#endif
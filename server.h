@@ -0,0 +1,259 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "util.h"
+
+bool send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+// Turns the CGI style output of the handlers (header block, blank line,
+// body) into an HTTP/1.1 response on a socket. Responses without a
+// Content-Length are sent with chunked transfer encoding, one chunk per
+// flush, so an early flush reaches the client immediately. Responses that
+// cannot have a body (1xx, 204, 304 and any answer to HEAD) are sent
+// with their header block alone.
+class http_response_buf : public std::streambuf {
+    public:
+        http_response_buf(int fd, bool head_request) : first_byte(0), fd(fd), head_request(head_request), headers_done(false), chunked(false), bodyless(false), failed(false) {
+            setp(buffer, buffer + sizeof(buffer));
+        }
+        bool finish() {
+            if (flush_buffer() < 0) {
+                return false;
+            }
+            if ( ! headers_done) {
+                // the handler never finished its header block
+                head += "\r\n\r\n";
+                if (parse_headers() < 0) {
+                    return false;
+                }
+            }
+            if (chunked) {
+                failed = ! send_all(fd, "0\r\n\r\n", 5) || failed;
+            }
+            return ! failed;
+        }
+        std::string status;
+        double first_byte;
+    protected:
+        int_type overflow(int_type c) override {
+            if (flush_buffer() < 0) {
+                return traits_type::eof();
+            }
+            if (c != traits_type::eof()) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+        int sync() override {
+            return flush_buffer();
+        }
+    private:
+        int fd;
+        bool head_request, headers_done, chunked, bodyless, failed;
+        std::string head;
+        char buffer[16384];
+
+        int flush_buffer() {
+            size_t len = pptr() - pbase();
+            setp(buffer, buffer + sizeof(buffer));
+            if (failed) {
+                return -1;
+            }
+            if (headers_done) {
+                return write_body(buffer, len);
+            }
+            head.append(buffer, len);
+            return parse_headers();
+        }
+        int parse_headers() {
+            size_t end = head.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                return 0;
+            }
+            std::string out, body = head.substr(end + 4);
+            status = "200 OK";
+            bool has_length = false;
+            size_t pos = 0;
+            while (pos < end) {
+                size_t eol = head.find("\r\n", pos);
+                std::string line = head.substr(pos, eol - pos);
+                pos = eol + 2;
+                if (strncasecmp(line.c_str(), "Status:", 7) == 0) {
+                    status = line.substr(line.find_first_not_of(' ', 7));
+                    continue;
+                }
+                if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+                    has_length = true;
+                }
+                if ( ! line.empty()) {
+                    out += line + "\r\n";
+                }
+            }
+            int code = atoi(status.c_str());
+            bodyless = head_request || code / 100 == 1 || code == 204 || code == 304;
+            chunked = ! has_length && ! bodyless;
+            out = "HTTP/1.1 " + status + "\r\n" + out;
+            if (chunked) {
+                out += "Transfer-Encoding: chunked\r\n";
+            }
+            out += "Connection: close\r\n\r\n";
+            headers_done = true;
+            head.clear();
+            if ( ! send_all(fd, out.data(), out.size())) {
+                failed = true;
+                return -1;
+            }
+            return write_body(body.data(), body.size());
+        }
+        int write_body(const char *data, size_t len) {
+            if (len == 0 || bodyless) {
+                return 0;
+            }
+            if (first_byte == 0) {
+                first_byte = now_ms();
+            }
+            if (chunked) {
+                char size[20];
+                int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+                failed = ! send_all(fd, size, n) || ! send_all(fd, data, len) || ! send_all(fd, "\r\n", 2);
+            } else {
+                failed = ! send_all(fd, data, len);
+            }
+            return failed ? -1 : 0;
+        }
+};
+// Reads the request head and exposes it to the handler the same way a CGI
+// gateway would: REQUEST_METHOD, REQUEST_URI, QUERY_STRING and HTTP_*.
+bool read_request(int fd, std::vector<std::string> &env_names) {
+    std::string head;
+    char buff[4096];
+    while (head.find("\r\n\r\n") == std::string::npos) {
+        if (head.size() > 65536) {
+            return false;
+        }
+        ssize_t n = recv(fd, buff, sizeof(buff), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        head.append(buff, n);
+    }
+    for (auto name = env_names.begin(); name != env_names.end(); ++name) {
+        unsetenv(name->c_str());
+    }
+    env_names.clear();
+    size_t eol = head.find("\r\n");
+    std::string line = head.substr(0, eol);
+    size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1) {
+        return false;
+    }
+    std::string uri = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t query = uri.find('?');
+    setenv("REQUEST_METHOD", line.substr(0, sp1).c_str(), 1);
+    setenv("REQUEST_URI", uri.c_str(), 1);
+    setenv("QUERY_STRING", query == std::string::npos ? "" : uri.substr(query + 1).c_str(), 1);
+    size_t pos = eol + 2;
+    while (true) {
+        eol = head.find("\r\n", pos);
+        if (eol == pos || eol == std::string::npos) {
+            break;
+        }
+        line = head.substr(pos, eol - pos);
+        pos = eol + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = "HTTP_";
+        for (size_t i = 0; i < colon; i++) {
+            name += line[i] == '-' ? '_' : toupper((unsigned char)line[i]);
+        }
+        std::string value = line.substr(colon + 1);
+        setenv(name.c_str(), trim(value).c_str(), 1);
+        env_names.push_back(name);
+    }
+    return true;
+}
+// Built-in server mode: one persistent process answering requests in turn,
+// so the database connection and in-process state outlive a request.
+int serve(int port, int (*handler)()) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        std::cout << "Could not create socket" << std::endl;
+        return 1;
+    }
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 128) != 0) {
+        std::cout << "Could not listen on 127.0.0.1:" << port << std::endl;
+        close(sock);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    std::cerr << "Listening on 127.0.0.1:" << port << std::endl;
+    std::vector<std::string> env_names;
+    while (true) {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (read_request(fd, env_names)) {
+            double start = now_ms();
+            const char *method = getenv("REQUEST_METHOD");
+            http_response_buf response(fd, method != NULL && strcmp(method, "HEAD") == 0);
+            std::streambuf *old = std::cout.rdbuf(&response);
+            handler();
+            std::cout.flush();
+            std::cout.rdbuf(old);
+            response.finish();
+            double end = now_ms();
+            // ttfb is measured to the first body byte, after the headers
+            std::cerr << getenv("REQUEST_METHOD") << " " << getenv("REQUEST_URI") << " " << response.status
+                << " ttfb=" << (response.first_byte > 0 ? response.first_byte - start : end - start) << "ms"
+                << " total=" << end - start << "ms" << std::endl;
+        }
+        close(fd);
+    }
+    close(sock);
+    return 0;
+}
+
+#endif
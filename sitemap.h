@@ -0,0 +1,323 @@
+#ifndef _SITEMAP_H
+#define _SITEMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include "sqlite3.h"
+#include "util.h"
+#include "html.h"
+#include "cache.h"
+#include "config.h"
+#include "archive.h"
+
+// Sitemaps for crawlers: "/sitemap.xml" is an index of
+// "/sitemap-pages.xml" (the homepage and month archives) and of shards of
+// posts and terms, "/sitemap-posts-<n>.xml" and "/sitemap-terms-<n>.xml".
+// Shard n holds the rows with ids in ((n - 1) * sitemap_shard,
+// n * sitemap_shard], so a new post only ever changes the last shard and
+// a shard never passes the protocol's 50,000 URLs. Every file is written
+// row by row as the query steps, in the same memory at any size, into
+// the page cache layout with a gzip variant beside it.
+const long long sitemap_shard = 50000;
+
+enum sitemap_kind_t {
+    SITEMAP_NONE = 0,
+    SITEMAP_INDEX,
+    SITEMAP_PAGES,
+    SITEMAP_POSTS,
+    SITEMAP_TERMS
+};
+
+bool is_sitemap_path(const std::string &path) {
+    return path.size() >= 12 && path.compare(0, 8, "/sitemap") == 0 && path.compare(path.size() - 4, 4, ".xml") == 0;
+}
+
+std::string sitemap_shard_url(sitemap_kind_t kind, long long shard) {
+    return std::string(kind == SITEMAP_POSTS ? "/sitemap-posts-" : "/sitemap-terms-") + std::to_string(shard) + ".xml";
+}
+// Which sitemap uri names; shard is set for post and term shards.
+sitemap_kind_t sitemap_kind(const std::string &uri, long long &shard) {
+    shard = 0;
+    if (uri == "/sitemap.xml") {
+        return SITEMAP_INDEX;
+    }
+    if (uri == "/sitemap-pages.xml") {
+        return SITEMAP_PAGES;
+    }
+    sitemap_kind_t kind = SITEMAP_NONE;
+    size_t at = 0;
+    if (uri.compare(0, 15, "/sitemap-posts-") == 0) {
+        kind = SITEMAP_POSTS;
+        at = 15;
+    } else if (uri.compare(0, 15, "/sitemap-terms-") == 0) {
+        kind = SITEMAP_TERMS;
+        at = 15;
+    }
+    if (kind == SITEMAP_NONE || ! is_sitemap_path(uri)) {
+        return SITEMAP_NONE;
+    }
+    std::string number = uri.substr(at, uri.size() - at - 4);
+    if (number.empty() || number[0] == '0' || number.size() > 12 || number.find_first_not_of("0123456789") != std::string::npos) {
+        return SITEMAP_NONE;
+    }
+    shard = atoll(number.c_str());
+    return kind;
+}
+// "2020-01-02T10:00:00Z"
+void append_w3c_date(std::string &out, long long t) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    char buff[32];
+    strftime(buff, sizeof(buff), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    out += buff;
+}
+// A stored file written as it is produced: the identity file and its
+// gzip variant go to temporary names of their own (temp_path) and are
+// renamed over the old ones by
+// commit(), the variant first, as page_store() does. Anything not
+// committed is removed.
+class stream_file {
+    public:
+        stream_file(const std::string &path) : path(path), tmp(temp_path(path)), gz_tmp(temp_path(path + ".gz")), fp(NULL), gz(NULL), ok(false) {
+            if (path.empty() || ! mkdirAll(path.substr(0, path.find_last_of(PATH_SEPARATOR)))) {
+                return;
+            }
+            fp = fopen(tmp.c_str(), "wbx");
+            gz = gzopen(gz_tmp.c_str(), "wb9x");
+            ok = fp != NULL && gz != NULL;
+        }
+        ~stream_file() {
+            close();
+            remove(tmp.c_str());
+            remove(gz_tmp.c_str());
+        }
+        void write(std::string_view data) {
+            if (ok && ! data.empty()) {
+                ok = fwrite(data.data(), 1, data.size(), fp) == data.size() && gzwrite(gz, data.data(), data.size()) == (int)data.size();
+            }
+        }
+        bool commit() {
+            close();
+            if ( ! ok || rename(gz_tmp.c_str(), (path + ".gz").c_str()) != 0) {
+                return false;
+            }
+            // an older brotli copy would be served in its place
+            remove((path + ".br").c_str());
+            return rename(tmp.c_str(), path.c_str()) == 0;
+        }
+    private:
+        std::string path, tmp, gz_tmp;
+        FILE *fp;
+        gzFile gz;
+        bool ok;
+
+        void close() {
+            if (fp != NULL) {
+                ok = fclose(fp) == 0 && ok;
+                fp = NULL;
+            }
+            if (gz != NULL) {
+                ok = gzclose(gz) == Z_OK && ok;
+                gz = NULL;
+            }
+        }
+};
+// url is the encoded path below the domain; lastmod 0 is left out.
+void sitemap_url(stream_file &file, std::string &buff, std::string_view domain, std::string_view url, long long lastmod) {
+    buff.assign("<url><loc>").append(domain).append(url);
+    buff += "</loc>";
+    if (lastmod > 0) {
+        buff += "<lastmod>";
+        append_w3c_date(buff, lastmod);
+        buff += "</lastmod>";
+    }
+    buff += "</url>";
+    file.write(buff);
+}
+
+long long sitemap_max_id(sqlite3 *db, const char *table) {
+    sqlite3_stmt *stmt = NULL;
+    std::string sql = std::string("SELECT coalesce(max(id), 0) FROM ") + table + ";";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    long long id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    return id;
+}
+// Whether shard holds any row that goes into the sitemap: one seek.
+bool sitemap_shard_used(sqlite3 *db, sitemap_kind_t kind, long long shard) {
+    const char *sql = kind == SITEMAP_POSTS
+        ? "SELECT 1 FROM posts WHERE id > ?1 AND id <= ?2 LIMIT 1;"
+        : "SELECT 1 FROM terms WHERE id > ?1 AND id <= ?2 AND post_count > 0 LIMIT 1;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, (shard - 1) * sitemap_shard);
+    sqlite3_bind_int64(stmt, 2, shard * sitemap_shard);
+    bool used = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return used;
+}
+
+const char *urlset_begin = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><urlset xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">";
+
+// The newest pubtime in [since, until): one seek of posts_pubtime.
+long long newest_pubtime(sqlite3_stmt *stmt, long long since, long long until) {
+    sqlite3_bind_int64(stmt, 1, since);
+    sqlite3_bind_int64(stmt, 2, until);
+    long long pubtime = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_reset(stmt);
+    return pubtime;
+}
+// The homepage and the month archives, each dated by its newest post.
+bool write_pages_urlset(sqlite3 *db, stream_file &file) {
+    std::vector<archive_month_t> months;
+    sqlite3_stmt *stmt = NULL;
+    if ( ! load_months(db, months) || sqlite3_prepare_v2(db, "SELECT pubtime FROM posts WHERE pubtime >= ?1 AND pubtime < ?2"
+            " ORDER BY pubtime DESC LIMIT 1;", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    std::string domain = htmlspecialchars(config.domain), buff;
+    file.write(urlset_begin);
+    sitemap_url(file, buff, domain, "/", newest_pubtime(stmt, 1, 1LL << 62));
+    for (auto month = months.begin(); month != months.end(); ++month) {
+        long long since, until;
+        month_bounds(month->month, since, until);
+        sitemap_url(file, buff, domain, archive_url(month->month), newest_pubtime(stmt, since, until));
+    }
+    sqlite3_finalize(stmt);
+    file.write("</urlset>");
+    return true;
+}
+// A shard of posts, dated by their pubdate, or of terms, dated by their
+// newest post through post_terms_listing. Terms do not record whether
+// they are tags or categories; they are listed under /tu-khoa/ as the
+// homepage links them. False when a query fails.
+bool write_rows_urlset(sqlite3 *db, stream_file &file, sitemap_kind_t kind, long long shard) {
+    const char *sql = kind == SITEMAP_POSTS
+        ? "SELECT slug, pubtime FROM posts WHERE id > ?1 AND id <= ?2 ORDER BY id;"
+        : "SELECT slug, (SELECT pubtime FROM post_terms WHERE term_id = terms.id ORDER BY pubtime DESC LIMIT 1) FROM terms"
+            " WHERE id > ?1 AND id <= ?2 AND post_count > 0 ORDER BY id;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, (shard - 1) * sitemap_shard);
+    sqlite3_bind_int64(stmt, 2, shard * sitemap_shard);
+    std::string domain = htmlspecialchars(config.domain), url, buff;
+    file.write(urlset_begin);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        long long lastmod = sqlite3_column_int64(stmt, 1);
+        url.assign(kind == SITEMAP_TERMS ? "/tu-khoa/" : "/");
+        encode_url_to(std::string_view((const char*)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0)), url);
+        url += '/';
+        // slugs given in front matter may hold what XML escapes
+        if (url.find_first_of("&<>\"'") != std::string::npos) {
+            url = htmlspecialchars(url);
+        }
+        sitemap_url(file, buff, domain, url, lastmod);
+    }
+    sqlite3_finalize(stmt);
+    file.write("</urlset>");
+    return rc == SQLITE_DONE;
+}
+
+bool write_sitemap(sqlite3 *db, const std::string &root, const std::string &uri, bool rebuild = false);
+
+// The index lists the pages sitemap and every shard that holds rows.
+// Shards not stored yet are written first, or all of them when rebuild
+// is set; each is dated by its file's mtime, the last time a write
+// changed it.
+bool write_sitemap_index(sqlite3 *db, const std::string &root, bool rebuild) {
+    std::vector<std::string> uris;
+    uris.push_back("/sitemap-pages.xml");
+    sitemap_kind_t kinds[] = { SITEMAP_POSTS, SITEMAP_TERMS };
+    for (int i = 0; i < 2; i++) {
+        long long shards = (sitemap_max_id(db, kinds[i] == SITEMAP_POSTS ? "posts" : "terms") + sitemap_shard - 1) / sitemap_shard;
+        for (long long shard = 1; shard <= shards; shard++) {
+            if (sitemap_shard_used(db, kinds[i], shard)) {
+                uris.push_back(sitemap_shard_url(kinds[i], shard));
+            }
+        }
+    }
+    std::string domain = htmlspecialchars(config.domain), buff;
+    stream_file file(page_path(root, "/sitemap.xml"));
+    file.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?><sitemapindex xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">");
+    for (auto uri = uris.begin(); uri != uris.end(); ++uri) {
+        std::string path = page_path(root, *uri);
+        struct stat st;
+        if ((rebuild || stat(path.c_str(), &st) != 0) && ! write_sitemap(db, root, *uri)) {
+            return false;
+        }
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        buff.assign("<sitemap><loc>").append(domain).append(*uri);
+        buff += "</loc><lastmod>";
+        append_w3c_date(buff, st.st_mtime);
+        buff += "</lastmod></sitemap>";
+        file.write(buff);
+    }
+    file.write("</sitemapindex>");
+    return file.commit();
+}
+// Writes the sitemap file uri names into root. With rebuild the index
+// rewrites every shard, otherwise only those not stored. False when uri
+// names no sitemap or an empty shard, or the write fails.
+bool write_sitemap(sqlite3 *db, const std::string &root, const std::string &uri, bool rebuild) {
+    long long shard;
+    sitemap_kind_t kind = sitemap_kind(uri, shard);
+    if (kind == SITEMAP_INDEX) {
+        return write_sitemap_index(db, root, rebuild);
+    }
+    if (kind == SITEMAP_NONE || (kind != SITEMAP_PAGES && ! sitemap_shard_used(db, kind, shard))) {
+        return false;
+    }
+    stream_file file(page_path(root, uri));
+    bool ok = kind == SITEMAP_PAGES ? write_pages_urlset(db, file) : write_rows_urlset(db, file, kind, shard);
+    return ok && file.commit();
+}
+// The sitemap files a write changes once posts with ids above last_post
+// are added or edited and terms got posts: their shards, the pages
+// sitemap and the index. Purged, they are written again on their next
+// request, or at once by write_sitemap() of the index.
+std::vector<std::string> sitemap_urls(sqlite3 *db, long long last_post, const std::vector<std::string> &terms) {
+    std::vector<std::string> urls;
+    urls.push_back("/sitemap.xml");
+    urls.push_back("/sitemap-pages.xml");
+    long long max_post = sitemap_max_id(db, "posts");
+    for (long long shard = last_post / sitemap_shard + 1; shard <= (max_post + sitemap_shard - 1) / sitemap_shard; shard++) {
+        urls.push_back(sitemap_shard_url(SITEMAP_POSTS, shard));
+    }
+    sqlite3_stmt *stmt = NULL;
+    if (terms.empty() || sqlite3_prepare_v2(db, "SELECT id FROM terms WHERE slug = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return urls;
+    }
+    std::vector<long long> shards;
+    for (auto term = terms.begin(); term != terms.end(); ++term) {
+        sqlite3_bind_text(stmt, 1, term->c_str(), term->size(), SQLITE_STATIC);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            long long shard = (sqlite3_column_int64(stmt, 0) - 1) / sitemap_shard + 1;
+            if (std::find(shards.begin(), shards.end(), shard) == shards.end()) {
+                shards.push_back(shard);
+                urls.push_back(sitemap_shard_url(SITEMAP_TERMS, shard));
+            }
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return urls;
+}
+
+#endif
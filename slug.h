@@ -0,0 +1,147 @@
+#ifndef _SLUG_H
+#define _SLUG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <set>
+#include <algorithm>
+#include <string_view>
+#include "sqlite3.h"
+#include "fold.h"
+
+// Appends the slug of text to out: accents folded through the fold.h
+// tables, lowercase, and every run of separators turned into one '-'.
+// "Từ  khóa, C++" -> "tu-khoa-c". Precomposed and combining (NFD)
+// diacritics fold alike. A slug is never longer than its text, so it is
+// written in place into out grown once. ASCII, two-byte letters and the
+// U+1Exx block that holds the Vietnamese tone marks are decoded inline;
+// anything else goes through fold_codepoint().
+void slugify_to(std::string_view text, std::string &out) {
+    const unsigned char *s = (const unsigned char *)text.data();
+    size_t at = out.size(), n = text.size(), i = 0, w = 0;
+    out.resize(at + n);
+    char *o = &out[at];
+    bool sep = false;
+    while (i < n) {
+        unsigned char c = s[i];
+        char folded;
+        size_t len;
+        if (c < 0x80) {
+            folded = fold_ascii[c];
+            len = 1;
+        } else if (c >= 0xC2 && c <= 0xCD && i + 1 < n && (s[i + 1] & 0xC0) == 0x80) {
+            // U+0080..U+037F
+            unsigned int cp = ((c & 0x1F) << 6) | (s[i + 1] & 0x3F);
+            folded = cp < 0x370 ? fold_2byte[cp - 0x80] : FOLD_KEEP;
+            len = 2;
+        } else if (c == 0xE1 && i + 2 < n && s[i + 1] >= 0xB8 && s[i + 1] <= 0xBB && (s[i + 2] & 0xC0) == 0x80) {
+            // U+1E00..U+1EFF
+            folded = fold_1e[((s[i + 1] & 0x03) << 6) | (s[i + 2] & 0x3F)];
+            len = 3;
+        } else {
+            len = fold_codepoint(s + i, n - i, folded);
+        }
+        i += len;
+        if (folded > FOLD_SEP) {
+            // w <= i - len, so the '-' written when no separator is
+            // pending stays inside out and is overwritten
+            o[w] = '-';
+            w += sep;
+            sep = false;
+            o[w++] = folded;
+        } else if (folded == FOLD_SEP) {
+            sep = w > 0;
+        } else if (folded == FOLD_KEEP) {
+            if (sep) {
+                o[w++] = '-';
+                sep = false;
+            }
+            memcpy(o + w, s + i - len, len);
+            w += len;
+        }
+    }
+    out.resize(at + w);
+}
+
+std::string slugify(std::string_view text) {
+    std::string slug;
+    slugify_to(text, slug);
+    return slug;
+}
+// Whether the router takes slug for one of its fixed segments, which
+// would shadow a page stored under it.
+bool is_route_segment(std::string_view slug) {
+    static const char *fixed[] = { "feed", "tim-kiem", "tu-khoa", "chuyen-muc", "cu-hon", "moi-hon", "amp" };
+    for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+        if (slug == fixed[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+// slugify(text), or prefix-<8 hex digits of a hash of text> when that
+// names no page of its own: empty, as for "???", or one of the router's
+// fixed segments, as for "Feed". The hash keeps the slug the same each
+// time the text is imported.
+std::string route_slug(std::string_view text, const char *prefix) {
+    std::string slug = slugify(text);
+    if ( ! slug.empty() && ! is_route_segment(slug)) {
+        return slug;
+    }
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < text.size(); i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    char buff[16];
+    snprintf(buff, sizeof(buff), "-%08x", hash);
+    return prefix + std::string(buff);
+}
+// A slug for a new row of table that no row holds yet: slug itself when
+// it is free, otherwise the lowest free of slug-2, slug-3, ... Rows such
+// as "xin-chao-2024", from a title ending in a number, only fill the
+// number they hold. One probe of the table's slug index, and one range
+// scan of "slug-..." when slug is taken. Empty when a query fails.
+std::string unique_slug(sqlite3 *db, const char *table, const std::string &slug) {
+    std::string sql = std::string("SELECT slug FROM ") + table + " WHERE slug = ?1 LIMIT 1;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        return "";
+    }
+    sqlite3_bind_text(stmt, 1, slug.c_str(), slug.size(), SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc == SQLITE_DONE) {
+        return slug;
+    }
+    if (rc != SQLITE_ROW) {
+        return "";
+    }
+    sql = std::string("SELECT slug FROM ") + table + " WHERE slug > ?1 || '-' AND slug < ?1 || '.';";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        return "";
+    }
+    sqlite3_bind_text(stmt, 1, slug.c_str(), slug.size(), SQLITE_STATIC);
+    std::set<long long> taken;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        std::string_view row((const char*)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+        // "xin-chao-ban" and "xin-chao-02" hold no number of the family
+        if (row.size() > slug.size() + 1 && row.size() <= slug.size() + 18 && row[slug.size() + 1] != '0'
+                && row.find_first_not_of("0123456789", slug.size() + 1) == std::string_view::npos) {
+            taken.insert(atoll(row.data() + slug.size() + 1));
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        return "";
+    }
+    long long number = 2;
+    while (taken.count(number) > 0) {
+        number++;
+    }
+    return slug + "-" + std::to_string(number);
+}
+
+#endif
@@ -4,9 +4,12 @@
 #include <string>
 #include "util.h"
 
-std::string the_tag_url(term_t *t, std::string domain) {
-    domain = rtrim(domain, "/");
-    return domain + t->slug + "/";
+// Appends the URL of a tag's listing to out; domain as for
+// the_term_url().
+void the_tag_url(const term_t *t, std::string_view domain, std::string &out) {
+    out.append(domain).append("/tu-khoa/");
+    encode_url_to(t->slug, out);
+    out += '/';
 }
 
 #endif
\ No newline at end of file
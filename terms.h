@@ -0,0 +1,177 @@
+#ifndef _TERMS_H
+#define _TERMS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include "sqlite3.h"
+#include "html.h"
+#include "util.h"
+#include "tag.h"
+#include "db.h"
+
+// Every term with its post count, by name. One scan of the covering
+// terms_listing index, however many posts the archive holds.
+bool load_terms(sqlite3 *db, std::vector<term_t> &terms) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT id, name, slug, post_count FROM terms ORDER BY name, slug;", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        term_t term;
+        term.id = sqlite3_column_int64(stmt, 0);
+        term.name = (const char*)sqlite3_column_text(stmt, 1);
+        term.slug = (const char*)sqlite3_column_text(stmt, 2);
+        term.count = sqlite3_column_int(stmt, 3);
+        terms.push_back(term);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+// Every term of a persistent worker in one flat array, found by slug
+// through a minimal perfect hash: slot = hash(seed, slug) % n, with the
+// seed looked up from a first hash of the slug, and one string compare to
+// reject slugs that are not terms. Built with hash and displace: buckets
+// of first hashes are placed largest first, each trying seeds until its
+// slugs land on free slots, and single slug buckets take the slots left
+// over directly (stored as -slot - 1). refresh() reloads it when the
+// database changed; the worker calls it once per request, not per lookup.
+class term_dictionary {
+    public:
+        term_dictionary(sqlite3 *db) : db(db), watch(db) {
+        }
+        void refresh() {
+            if ( ! watch.changed()) {
+                return;
+            }
+            std::vector<term_t> loaded;
+            if ( ! load_terms(db, loaded) || ! build(loaded)) {
+                std::cerr << "Could not load the term dictionary" << std::endl;
+                build(std::vector<term_t>());
+            }
+        }
+        // By name, as load_terms() returns them.
+        const std::vector<term_t> &by_name() const {
+            return terms;
+        }
+        // The term with slug, or NULL.
+        const term_t *lookup(const std::string &slug) const {
+            size_t n = slots.size();
+            if (n == 0) {
+                return NULL;
+            }
+            int seed = seeds[hash(0, slug) % n];
+            const term_t *term = &terms[slots[seed < 0 ? -seed - 1 : hash(seed, slug) % n]];
+            return term->slug == slug ? term : NULL;
+        }
+        bool build(const std::vector<term_t> &loaded) {
+            terms = loaded;
+            // slugs are not unique in terms; the first one by name wins
+            std::vector<uint32_t> keys;
+            std::unordered_set<std::string> seen;
+            for (size_t i = 0; i < terms.size(); i++) {
+                if (seen.insert(terms[i].slug).second) {
+                    keys.push_back(i);
+                }
+            }
+            size_t n = keys.size();
+            seeds.assign(n, 0);
+            slots.assign(n, 0);
+            std::vector<std::vector<uint32_t> > buckets(n);
+            for (size_t i = 0; i < n; i++) {
+                buckets[hash(0, terms[keys[i]].slug) % n].push_back(keys[i]);
+            }
+            std::vector<uint32_t> order(n);
+            for (size_t i = 0; i < n; i++) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+            std::vector<bool> taken(n, false);
+            size_t b = 0;
+            for (; b < n && buckets[order[b]].size() > 1; b++) {
+                const std::vector<uint32_t> &bucket = buckets[order[b]];
+                std::vector<uint32_t> placed;
+                for (int seed = 1; placed.size() < bucket.size(); seed++) {
+                    if (seed > 1 << 20) {
+                        return false;
+                    }
+                    placed.clear();
+                    for (size_t k = 0; k < bucket.size(); k++) {
+                        uint32_t slot = hash(seed, terms[bucket[k]].slug) % n;
+                        if (taken[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+                            break;
+                        }
+                        placed.push_back(slot);
+                    }
+                    if (placed.size() == bucket.size()) {
+                        seeds[order[b]] = seed;
+                    }
+                }
+                for (size_t k = 0; k < bucket.size(); k++) {
+                    taken[placed[k]] = true;
+                    slots[placed[k]] = bucket[k];
+                }
+            }
+            for (size_t slot = 0; b < n && ! buckets[order[b]].empty(); b++) {
+                while (taken[slot]) {
+                    slot++;
+                }
+                taken[slot] = true;
+                slots[slot] = buckets[order[b]][0];
+                seeds[order[b]] = -(int)slot - 1;
+            }
+            return true;
+        }
+    private:
+        sqlite3 *db;
+        db_change_watch watch;
+        // terms by name; slots maps a hash slot to its term
+        std::vector<term_t> terms;
+        std::vector<int> seeds;
+        std::vector<uint32_t> slots;
+
+        // FNV-1a, seeded, with murmur3's finalizer: without it the low
+        // bits, which pick the slot, hardly depend on the seed
+        static uint32_t hash(uint32_t seed, const std::string &slug) {
+            uint32_t h = 2166136261u ^ seed * 16777619u;
+            for (size_t i = 0; i < slug.size(); i++) {
+                h = (h ^ (unsigned char)slug[i]) * 16777619u;
+            }
+            h ^= h >> 16;
+            h *= 0x85ebca6bu;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35u;
+            return h ^ (h >> 16);
+        }
+};
+
+// Each term as a link built by term_url, the_tag_url() or
+// the_term_url(); the items go through one reused buffer.
+void render_terms(const std::vector<term_t> &terms, void (*term_url)(const term_t *, std::string_view, std::string &)) {
+    std::cout << "<aside><ul>";
+    std::string html;
+    for (auto term = terms.begin(); term != terms.end(); ++term) {
+        if (term->count <= 0) {
+            continue;
+        }
+        html.assign("<li><a href=\"");
+        term_url(&*term, "", html);
+        html += "\">";
+        htmlspecialchars_to(term->name, html);
+        html.append("</a> (").append(std::to_string(term->count)) += ")</li>";
+        std::cout.write(html.data(), html.size());
+    }
+    std::cout << "</ul></aside>";
+}
+// Sidebar of the listings: each term that has posts, with its count.
+void render_terms(sqlite3 *db, void (*term_url)(const term_t *, std::string_view, std::string &)) {
+    std::vector<term_t> terms;
+    if (load_terms(db, terms)) {
+        render_terms(terms, term_url);
+    }
+}
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef _UTF8_H
+#define _UTF8_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+// UTF-8 checks for text on its way into the database. Import runs every
+// file through utf8_ingest() once, so pages can print stored text as it
+// is.
+//
+// Validation is a DFA over the byte classes of Unicode table 3-7: it
+// refuses overlong forms, surrogates and codepoints past U+10FFFF. Runs
+// of ASCII are skipped 16 bytes at a time with SSE2.
+#define UTF8_ACCEPT 0
+#define UTF8_REJECT 8
+
+typedef struct {
+    unsigned char byte_class[256];
+    unsigned char next[9][12];
+} utf8_dfa_t;
+
+constexpr utf8_dfa_t make_utf8_dfa() {
+    utf8_dfa_t t = {};
+    // 0: 00..7F, 1: 80..8F, 2: 90..9F, 3: A0..BF, 4: C0..C1 F5..FF,
+    // 5: C2..DF, 6: E0, 7: E1..EC EE..EF, 8: ED, 9: F0, 10: F1..F3, 11: F4
+    for (int c = 0; c < 256; c++) {
+        t.byte_class[c] = c < 0x80 ? 0 : c < 0x90 ? 1 : c < 0xA0 ? 2 : c < 0xC0 ? 3 : c < 0xC2 ? 4 : c < 0xE0 ? 5
+            : c == 0xE0 ? 6 : c == 0xED ? 8 : c < 0xF0 ? 7 : c == 0xF0 ? 9 : c < 0xF4 ? 10 : c == 0xF4 ? 11 : 4;
+    }
+    // states: 0 accept, 1..3 that many continuation bytes to go, 4 after
+    // E0 (A0..BF next), 5 after ED (80..9F), 6 after F0 (90..BF), 7 after
+    // F4 (80..8F), 8 reject
+    for (int s = 0; s < 9; s++) {
+        for (int c = 0; c < 12; c++) {
+            t.next[s][c] = UTF8_REJECT;
+        }
+    }
+    const unsigned char lead[12] = { UTF8_ACCEPT, UTF8_REJECT, UTF8_REJECT, UTF8_REJECT, UTF8_REJECT, 1, 4, 2, 5, 6, 3, 7 };
+    for (int c = 0; c < 12; c++) {
+        t.next[UTF8_ACCEPT][c] = lead[c];
+    }
+    for (int c = 1; c <= 3; c++) {
+        t.next[1][c] = UTF8_ACCEPT;
+        t.next[2][c] = 1;
+        t.next[3][c] = 2;
+    }
+    t.next[4][3] = 1;
+    t.next[5][1] = t.next[5][2] = 1;
+    t.next[6][2] = t.next[6][3] = 2;
+    t.next[7][1] = 2;
+    return t;
+}
+
+constexpr utf8_dfa_t utf8_dfa = make_utf8_dfa();
+
+// Length of the longest prefix of s that is valid UTF-8, s.size() when
+// all of it is.
+size_t utf8_valid_length(std::string_view s) {
+    const unsigned char *p = (const unsigned char *)s.data();
+    size_t n = s.size(), i = 0, start = 0;
+    int state = UTF8_ACCEPT;
+    while (i < n) {
+        if (state == UTF8_ACCEPT) {
+#ifdef __SSE2__
+            while (i + 16 <= n && _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i))) == 0) {
+                i += 16;
+            }
+#endif
+            while (i < n && p[i] < 0x80) {
+                i++;
+            }
+            if (i == n) {
+                break;
+            }
+            start = i;
+        }
+        state = utf8_dfa.next[state][utf8_dfa.byte_class[p[i]]];
+        if (state == UTF8_REJECT) {
+            return start;
+        }
+        i++;
+    }
+    return state == UTF8_ACCEPT ? n : start;
+}
+// Replaces every maximal invalid subpart of s with U+FFFD, the way
+// browsers decode it: a sequence cut short is one replacement, a stray
+// byte one each. Valid runs in between are found and copied whole.
+// Returns how many were replaced.
+size_t utf8_repair(std::string &s) {
+    size_t i = utf8_valid_length(s), n = s.size(), replaced = 0;
+    if (i == n) {
+        return 0;
+    }
+    const unsigned char *p = (const unsigned char *)s.data();
+    std::string out(s, 0, i);
+    while (i < n) {
+        // the bytes the DFA takes before refusing one, at least the first
+        size_t len = 0;
+        for (int state = UTF8_ACCEPT; i + len < n; len++) {
+            state = utf8_dfa.next[state][utf8_dfa.byte_class[p[i + len]]];
+            if (state == UTF8_REJECT) {
+                break;
+            }
+        }
+        i += std::max(len, (size_t)1);
+        out += "\xEF\xBF\xBD";
+        replaced++;
+        size_t valid = utf8_valid_length(std::string_view(s).substr(i));
+        out.append(s, i, valid);
+        i += valid;
+    }
+    s.swap(out);
+    return replaced;
+}
+
+// Canonical compositions of a Latin letter with one of the marks
+// Vietnamese writes: grave, acute, circumflex, tilde, breve, hook above,
+// horn and dot below (U+0300, 0301, 0302, 0303, 0306, 0309, 031B, 0323).
+// Keyed by base << 8 | (mark - U+0300), sorted. Generated with Python's
+// unicodedata (Unicode 14.0) from the decompositions of U+00C0..U+024F
+// and U+1E00..U+1EFF, keeping the pairs NFC composes.
+typedef struct {
+    uint32_t key;
+    uint16_t composed;
+} nfc_pair_t;
+
+const nfc_pair_t nfc_vietnamese_pairs[] = {
+    { 0x004100, 0x00C0 }, { 0x004101, 0x00C1 }, { 0x004102, 0x00C2 }, { 0x004103, 0x00C3 }, { 0x004106, 0x0102 }, { 0x004109, 0x1EA2 },
+    { 0x004123, 0x1EA0 }, { 0x004223, 0x1E04 }, { 0x004301, 0x0106 }, { 0x004302, 0x0108 }, { 0x004423, 0x1E0C }, { 0x004500, 0x00C8 },
+    { 0x004501, 0x00C9 }, { 0x004502, 0x00CA }, { 0x004503, 0x1EBC }, { 0x004506, 0x0114 }, { 0x004509, 0x1EBA }, { 0x004523, 0x1EB8 },
+    { 0x004701, 0x01F4 }, { 0x004702, 0x011C }, { 0x004706, 0x011E }, { 0x004802, 0x0124 }, { 0x004823, 0x1E24 }, { 0x004900, 0x00CC },
+    { 0x004901, 0x00CD }, { 0x004902, 0x00CE }, { 0x004903, 0x0128 }, { 0x004906, 0x012C }, { 0x004909, 0x1EC8 }, { 0x004923, 0x1ECA },
+    { 0x004A02, 0x0134 }, { 0x004B01, 0x1E30 }, { 0x004B23, 0x1E32 }, { 0x004C01, 0x0139 }, { 0x004C23, 0x1E36 }, { 0x004D01, 0x1E3E },
+    { 0x004D23, 0x1E42 }, { 0x004E00, 0x01F8 }, { 0x004E01, 0x0143 }, { 0x004E03, 0x00D1 }, { 0x004E23, 0x1E46 }, { 0x004F00, 0x00D2 },
+    { 0x004F01, 0x00D3 }, { 0x004F02, 0x00D4 }, { 0x004F03, 0x00D5 }, { 0x004F06, 0x014E }, { 0x004F09, 0x1ECE }, { 0x004F1B, 0x01A0 },
+    { 0x004F23, 0x1ECC }, { 0x005001, 0x1E54 }, { 0x005201, 0x0154 }, { 0x005223, 0x1E5A }, { 0x005301, 0x015A }, { 0x005302, 0x015C },
+    { 0x005323, 0x1E62 }, { 0x005423, 0x1E6C }, { 0x005500, 0x00D9 }, { 0x005501, 0x00DA }, { 0x005502, 0x00DB }, { 0x005503, 0x0168 },
+    { 0x005506, 0x016C }, { 0x005509, 0x1EE6 }, { 0x00551B, 0x01AF }, { 0x005523, 0x1EE4 }, { 0x005603, 0x1E7C }, { 0x005623, 0x1E7E },
+    { 0x005700, 0x1E80 }, { 0x005701, 0x1E82 }, { 0x005702, 0x0174 }, { 0x005723, 0x1E88 }, { 0x005900, 0x1EF2 }, { 0x005901, 0x00DD },
+    { 0x005902, 0x0176 }, { 0x005903, 0x1EF8 }, { 0x005909, 0x1EF6 }, { 0x005923, 0x1EF4 }, { 0x005A01, 0x0179 }, { 0x005A02, 0x1E90 },
+    { 0x005A23, 0x1E92 }, { 0x006100, 0x00E0 }, { 0x006101, 0x00E1 }, { 0x006102, 0x00E2 }, { 0x006103, 0x00E3 }, { 0x006106, 0x0103 },
+    { 0x006109, 0x1EA3 }, { 0x006123, 0x1EA1 }, { 0x006223, 0x1E05 }, { 0x006301, 0x0107 }, { 0x006302, 0x0109 }, { 0x006423, 0x1E0D },
+    { 0x006500, 0x00E8 }, { 0x006501, 0x00E9 }, { 0x006502, 0x00EA }, { 0x006503, 0x1EBD }, { 0x006506, 0x0115 }, { 0x006509, 0x1EBB },
+    { 0x006523, 0x1EB9 }, { 0x006701, 0x01F5 }, { 0x006702, 0x011D }, { 0x006706, 0x011F }, { 0x006802, 0x0125 }, { 0x006823, 0x1E25 },
+    { 0x006900, 0x00EC }, { 0x006901, 0x00ED }, { 0x006902, 0x00EE }, { 0x006903, 0x0129 }, { 0x006906, 0x012D }, { 0x006909, 0x1EC9 },
+    { 0x006923, 0x1ECB }, { 0x006A02, 0x0135 }, { 0x006B01, 0x1E31 }, { 0x006B23, 0x1E33 }, { 0x006C01, 0x013A }, { 0x006C23, 0x1E37 },
+    { 0x006D01, 0x1E3F }, { 0x006D23, 0x1E43 }, { 0x006E00, 0x01F9 }, { 0x006E01, 0x0144 }, { 0x006E03, 0x00F1 }, { 0x006E23, 0x1E47 },
+    { 0x006F00, 0x00F2 }, { 0x006F01, 0x00F3 }, { 0x006F02, 0x00F4 }, { 0x006F03, 0x00F5 }, { 0x006F06, 0x014F }, { 0x006F09, 0x1ECF },
+    { 0x006F1B, 0x01A1 }, { 0x006F23, 0x1ECD }, { 0x007001, 0x1E55 }, { 0x007201, 0x0155 }, { 0x007223, 0x1E5B }, { 0x007301, 0x015B },
+    { 0x007302, 0x015D }, { 0x007323, 0x1E63 }, { 0x007423, 0x1E6D }, { 0x007500, 0x00F9 }, { 0x007501, 0x00FA }, { 0x007502, 0x00FB },
+    { 0x007503, 0x0169 }, { 0x007506, 0x016D }, { 0x007509, 0x1EE7 }, { 0x00751B, 0x01B0 }, { 0x007523, 0x1EE5 }, { 0x007603, 0x1E7D },
+    { 0x007623, 0x1E7F }, { 0x007700, 0x1E81 }, { 0x007701, 0x1E83 }, { 0x007702, 0x0175 }, { 0x007723, 0x1E89 }, { 0x007900, 0x1EF3 },
+    { 0x007901, 0x00FD }, { 0x007902, 0x0177 }, { 0x007903, 0x1EF9 }, { 0x007909, 0x1EF7 }, { 0x007923, 0x1EF5 }, { 0x007A01, 0x017A },
+    { 0x007A02, 0x1E91 }, { 0x007A23, 0x1E93 }, { 0x00C200, 0x1EA6 }, { 0x00C201, 0x1EA4 }, { 0x00C203, 0x1EAA }, { 0x00C209, 0x1EA8 },
+    { 0x00C501, 0x01FA }, { 0x00C601, 0x01FC }, { 0x00C701, 0x1E08 }, { 0x00CA00, 0x1EC0 }, { 0x00CA01, 0x1EBE }, { 0x00CA03, 0x1EC4 },
+    { 0x00CA09, 0x1EC2 }, { 0x00CF01, 0x1E2E }, { 0x00D400, 0x1ED2 }, { 0x00D401, 0x1ED0 }, { 0x00D403, 0x1ED6 }, { 0x00D409, 0x1ED4 },
+    { 0x00D501, 0x1E4C }, { 0x00D801, 0x01FE }, { 0x00DC00, 0x01DB }, { 0x00DC01, 0x01D7 }, { 0x00E200, 0x1EA7 }, { 0x00E201, 0x1EA5 },
+    { 0x00E203, 0x1EAB }, { 0x00E209, 0x1EA9 }, { 0x00E501, 0x01FB }, { 0x00E601, 0x01FD }, { 0x00E701, 0x1E09 }, { 0x00EA00, 0x1EC1 },
+    { 0x00EA01, 0x1EBF }, { 0x00EA03, 0x1EC5 }, { 0x00EA09, 0x1EC3 }, { 0x00EF01, 0x1E2F }, { 0x00F400, 0x1ED3 }, { 0x00F401, 0x1ED1 },
+    { 0x00F403, 0x1ED7 }, { 0x00F409, 0x1ED5 }, { 0x00F501, 0x1E4D }, { 0x00F801, 0x01FF }, { 0x00FC00, 0x01DC }, { 0x00FC01, 0x01D8 },
+    { 0x010200, 0x1EB0 }, { 0x010201, 0x1EAE }, { 0x010203, 0x1EB4 }, { 0x010209, 0x1EB2 }, { 0x010300, 0x1EB1 }, { 0x010301, 0x1EAF },
+    { 0x010303, 0x1EB5 }, { 0x010309, 0x1EB3 }, { 0x011200, 0x1E14 }, { 0x011201, 0x1E16 }, { 0x011300, 0x1E15 }, { 0x011301, 0x1E17 },
+    { 0x014C00, 0x1E50 }, { 0x014C01, 0x1E52 }, { 0x014D00, 0x1E51 }, { 0x014D01, 0x1E53 }, { 0x016801, 0x1E78 }, { 0x016901, 0x1E79 },
+    { 0x01A000, 0x1EDC }, { 0x01A001, 0x1EDA }, { 0x01A003, 0x1EE0 }, { 0x01A009, 0x1EDE }, { 0x01A023, 0x1EE2 }, { 0x01A100, 0x1EDD },
+    { 0x01A101, 0x1EDB }, { 0x01A103, 0x1EE1 }, { 0x01A109, 0x1EDF }, { 0x01A123, 0x1EE3 }, { 0x01AF00, 0x1EEA }, { 0x01AF01, 0x1EE8 },
+    { 0x01AF03, 0x1EEE }, { 0x01AF09, 0x1EEC }, { 0x01AF23, 0x1EF0 }, { 0x01B000, 0x1EEB }, { 0x01B001, 0x1EE9 }, { 0x01B003, 0x1EEF },
+    { 0x01B009, 0x1EED }, { 0x01B023, 0x1EF1 }, { 0x022806, 0x1E1C }, { 0x022906, 0x1E1D }, { 0x1EA002, 0x1EAC }, { 0x1EA006, 0x1EB6 },
+    { 0x1EA102, 0x1EAD }, { 0x1EA106, 0x1EB7 }, { 0x1EB802, 0x1EC6 }, { 0x1EB902, 0x1EC7 }, { 0x1ECC02, 0x1ED8 }, { 0x1ECD02, 0x1ED9 },
+};
+
+const size_t nfc_vietnamese_count = sizeof(nfc_vietnamese_pairs) / sizeof(nfc_vietnamese_pairs[0]);
+
+// Canonical combining class of the marks above; 0 for any other mark.
+int nfc_vietnamese_ccc(uint32_t mark) {
+    switch (mark) {
+        case 0x300: case 0x301: case 0x302: case 0x303: case 0x306: case 0x309: return 230;
+        case 0x31B: return 216;
+        case 0x323: return 220;
+        default: return 0;
+    }
+}
+
+uint32_t nfc_compose(uint32_t base, uint32_t mark) {
+    uint32_t key = base << 8 | (mark - 0x300);
+    const nfc_pair_t *end = nfc_vietnamese_pairs + nfc_vietnamese_count;
+    const nfc_pair_t *found = std::lower_bound(nfc_vietnamese_pairs, end, key, [](const nfc_pair_t &pair, uint32_t k) { return pair.key < k; });
+    return found != end && found->key == key ? found->composed : 0;
+}
+// Splits a composed letter back into its base and mark; false for a
+// letter the table does not compose.
+bool nfc_decompose(uint32_t composed, uint32_t &base, uint32_t &mark) {
+    for (size_t i = 0; i < nfc_vietnamese_count; i++) {
+        if (nfc_vietnamese_pairs[i].composed == composed) {
+            base = nfc_vietnamese_pairs[i].key >> 8;
+            mark = 0x300 + (nfc_vietnamese_pairs[i].key & 0xFF);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t utf8_decode(const unsigned char *p, size_t &len) {
+    if (p[0] < 0x80) {
+        len = 1;
+        return p[0];
+    }
+    if (p[0] < 0xE0) {
+        len = 2;
+        return (p[0] & 0x1F) << 6 | (p[1] & 0x3F);
+    }
+    if (p[0] < 0xF0) {
+        len = 3;
+        return (p[0] & 0x0F) << 12 | (p[1] & 0x3F) << 6 | (p[2] & 0x3F);
+    }
+    len = 4;
+    return (p[0] & 0x07) << 18 | (p[1] & 0x3F) << 12 | (p[2] & 0x3F) << 6 | (p[3] & 0x3F);
+}
+
+void utf8_append(uint32_t cp, std::string &out) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | cp >> 6);
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xE0 | cp >> 12);
+        out += (char)(0x80 | (cp >> 6 & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+// NFC for Vietnamese typed with combining marks, as macOS and some input
+// methods produce it: "e" U+0302 U+0301 becomes "ế". A letter and the
+// marks after it are decomposed, put in canonical order and composed
+// again through the table above. Letters outside ASCII, đ and the table,
+// and runs holding other marks, are left as they are.
+// s must be valid UTF-8; text without a byte of U+0300..U+036F is not
+// copied. Returns whether s changed.
+bool nfc_vietnamese(std::string &s) {
+    const unsigned char *p = (const unsigned char *)s.data();
+    size_t n = s.size();
+    if (memchr(p, 0xCC, n) == NULL && memchr(p, 0xCD, n) == NULL) {
+        return false;
+    }
+    std::string out;
+    out.reserve(n);
+    size_t i = 0;
+    while (i < n) {
+        // copy up to the letter before the next mark in one go
+        size_t next = i;
+        while (next < n && p[next] != 0xCC && p[next] != 0xCD) {
+            next++;
+        }
+        if (next == n) {
+            out.append(s, i, n - i);
+            break;
+        }
+        size_t letter_at = next;
+        while (letter_at > i && (letter_at == next || (p[letter_at] & 0xC0) == 0x80)) {
+            letter_at--;
+        }
+        out.append(s, i, letter_at - i);
+        i = letter_at;
+        size_t len, end;
+        uint32_t base = utf8_decode(p + i, len);
+        // the combining marks U+0300..U+036F after it
+        for (end = i + len; end + 1 < n && (p[end] == 0xCC || (p[end] == 0xCD && p[end + 1] < 0xB0)); end += 2) {
+        }
+        if (end == i + len) {
+            out.append(s, i, len);
+            i = end;
+            continue;
+        }
+        uint32_t marks[16];
+        size_t count = 0;
+        uint32_t letter, mark;
+        // đ has no decomposition, its marks are only put in order
+        bool known = base < 0x80 || base == 0x110 || base == 0x111 || nfc_decompose(base, letter, mark);
+        // the letter's own marks first, innermost first: ậ is a, U+0323, U+0302
+        while (known && base >= 0x80 && nfc_decompose(base, letter, mark)) {
+            memmove(marks + 1, marks, count * sizeof(uint32_t));
+            marks[0] = mark;
+            count++;
+            base = letter;
+        }
+        for (size_t j = i + len; known && j < end; j += 2) {
+            mark = (p[j] & 0x1F) << 6 | (p[j + 1] & 0x3F);
+            known = nfc_vietnamese_ccc(mark) != 0 && count < 16;
+            if (known) {
+                marks[count++] = mark;
+            }
+        }
+        if ( ! known) {
+            out.append(s, i, end - i);
+            i = end;
+            continue;
+        }
+        // canonical order: by class, stable; a few marks at most
+        for (size_t j = 1; j < count; j++) {
+            for (size_t k = j; k > 0 && nfc_vietnamese_ccc(marks[k - 1]) > nfc_vietnamese_ccc(marks[k]); k--) {
+                std::swap(marks[k - 1], marks[k]);
+            }
+        }
+        // a mark composes unless a mark left before it has its class
+        uint32_t kept[16];
+        size_t left = 0;
+        for (size_t j = 0; j < count; j++) {
+            uint32_t composed = left == 0 || nfc_vietnamese_ccc(kept[left - 1]) < nfc_vietnamese_ccc(marks[j]) ? nfc_compose(base, marks[j]) : 0;
+            if (composed != 0) {
+                base = composed;
+            } else {
+                kept[left++] = marks[j];
+            }
+        }
+        utf8_append(base, out);
+        for (size_t j = 0; j < left; j++) {
+            utf8_append(kept[j], out);
+        }
+        i = end;
+    }
+    if (out == s) {
+        return false;
+    }
+    s.swap(out);
+    return true;
+}
+// The ingest stage: invalid UTF-8 is repaired, or refused when repair is
+// off, and Vietnamese is composed to NFC when nfc is on. Returns false
+// for refused text; repaired counts the replacement characters put in.
+bool utf8_ingest(std::string &text, bool repair, bool nfc, size_t &repaired) {
+    repaired = 0;
+    if (utf8_valid_length(text) != text.size()) {
+        if ( ! repair) {
+            return false;
+        }
+        repaired = utf8_repair(text);
+    }
+    if (nfc) {
+        nfc_vietnamese(text);
+    }
+    return true;
+}
+
+#endif
@@ -2,9 +2,16 @@
 #define _UTIL_H
 
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 #include <string>
+#include <string_view>
 #include <iostream>
+#include <chrono>
 #include <sys/stat.h>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
 #if defined _WIN32 || defined __CYGWIN__ || defined WIN32
     #include <direct.h>
     #define GetCurrentDir _getcwd
@@ -19,7 +26,14 @@
 #endif
 typedef struct {
     std::string name, slug;
+    long long id;
+    // posts filed under the term, kept by triggers on post_terms
+    int count;
 } term_t;
+// Monotonic milliseconds, for timing output of the command line tools.
+double now_ms() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 // https://stackoverflow.com/a/12774387
 bool file_exists(const std::string& name) {
     struct stat buffer;
@@ -75,38 +89,16 @@ std::string& rtrim(std::string& str, const std::string& chars = "\t\n\v\f\r ") {
 std::string& trim(std::string& str, const std::string& chars = "\t\n\v\f\r ") {
     return ltrim(rtrim(str, chars), chars);
 }
-// https://github.com/yhirose/cpp-httplib/blob/master/httplib.h#L921
-bool is_hex(char c, int &v) {
-    if (0x20 <= c && isdigit(c)) {
-        v = c - '0';
-        return true;
-    } else if ('A' <= c && c <= 'F') {
-        v = c - 'A' + 10;
-        return true;
-    } else if ('a' <= c && c <= 'f') {
-        v = c - 'a' + 10;
-        return true;
-    }
-    return false;
+// The same trims as views into str, which is left alone and not copied.
+std::string_view ltrim_view(std::string_view str, std::string_view chars = "\t\n\v\f\r ") {
+    size_t start = str.find_first_not_of(chars);
+    return start == std::string_view::npos ? str.substr(str.size()) : str.substr(start);
 }
-// https://github.com/yhirose/cpp-httplib/blob/master/httplib.h#L935
-bool from_hex_to_i(const std::string &s, size_t i, size_t cnt, int &val) {
-    if (i >= s.size()) {
-        return false;
-    }
-    val = 0;
-    for (; cnt; i++, cnt--) {
-        if (!s[i]) {
-            return false;
-        }
-        int v = 0;
-        if (is_hex(s[i], v)) {
-            val = val * 16 + v;
-        } else {
-            return false;
-        }
-    }
-    return true;
+std::string_view rtrim_view(std::string_view str, std::string_view chars = "\t\n\v\f\r ") {
+    return str.substr(0, str.find_last_not_of(chars) + 1);
+}
+std::string_view trim_view(std::string_view str, std::string_view chars = "\t\n\v\f\r ") {
+    return ltrim_view(rtrim_view(str, chars), chars);
 }
 // https://github.com/yhirose/cpp-httplib/blob/master/httplib.h#L962
 size_t to_utf8(int code, char *buff) {
@@ -139,69 +131,158 @@ size_t to_utf8(int code, char *buff) {
     // NOTREACHED
     return 0;
 }
-// https://github.com/yhirose/cpp-httplib/blob/master/httplib.h#L1844
-std::string encode_url(const std::string &s) {
-    std::string result;
-    for (auto i = 0; s[i]; i++) {
-        switch (s[i]) {
-            case ' ': result += "%20"; break;
-            case '+': result += "%2B"; break;
-            case '\r': result += "%0D"; break;
-            case '\n': result += "%0A"; break;
-            case '\'': result += "%27"; break;
-            case ',': result += "%2C"; break;
-            case ':': result += "%3A"; break;
-            case ';': result += "%3B"; break;
-            default:
-                auto c = static_cast<uint8_t>(s[i]);
-                if (c >= 0x80) {
-                    result += '%';
-                    char hex[4];
-                    size_t len = snprintf(hex, sizeof(hex) - 1, "%02X", c);
-                    assert(len == 2);
-                    result.append(hex, len);
-                } else {
-                    result += s[i];
-                }
-                break;
+// Byte classes for the URL coders: the value of a hex digit (-1 for other
+// bytes) and whether encode_url() escapes a byte.
+typedef struct {
+    signed char hex[256];
+    bool escape[256];
+} url_tables_t;
+
+constexpr url_tables_t make_url_tables() {
+    url_tables_t t = {};
+    for (int c = 0; c < 256; c++) {
+        t.hex[c] = c >= '0' && c <= '9' ? c - '0' : (c >= 'A' && c <= 'F' ? c - 'A' + 10 : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1));
+        t.escape[c] = c >= 0x80 || c == ' ' || c == '+' || c == '\r' || c == '\n' || c == '\'' || c == ',' || c == ':' || c == ';'
+            || c == '"' || c == '#' || c == '%' || c == '&' || c == '<' || c == '=' || c == '>' || c == '?';
+    }
+    return t;
+}
+
+constexpr url_tables_t url_tables = make_url_tables();
+const char url_hex_digits[] = "0123456789ABCDEF";
+
+// Length of the leading run of s that encode_url() copies as is. Slugs
+// are mostly such a run; SSE2 passes over 16 bytes at a time that hold
+// no byte below '-' (which takes in the high ones, signed) and none of
+// ':' to '?'.
+size_t url_plain_run(const char *s, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi8('-'), after_digits = _mm_set1_epi8('9'), at = _mm_set1_epi8('@');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hit = _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_and_si128(_mm_cmpgt_epi8(v, after_digits), _mm_cmplt_epi8(v, at)));
+        if (_mm_movemask_epi8(hit) != 0) {
+            break;
+        }
+    }
+#endif
+    while (i < n && ! url_tables.escape[(uint8_t)s[i]]) {
+        i++;
+    }
+    return i;
+}
+// Length of the leading run of s without '%' or '+', which decoding
+// copies as is.
+size_t url_encoded_run(const char *s, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i percent = _mm_set1_epi8('%'), plus = _mm_set1_epi8('+');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, percent), _mm_cmpeq_epi8(v, plus)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
         }
     }
+#endif
+    while (i < n && s[i] != '%' && s[i] != '+') {
+        i++;
+    }
+    return i;
+}
+// Appends s to out with spaces, '+', line breaks, quotes, ',', ':', ';',
+// '#', '%', '&', '<', '=', '>', '?' and every non-ASCII byte
+// percent-encoded, as encode_url() returns it. Nothing left in the result
+// needs escaping in an HTML attribute, so it goes into href as is. Plain
+// runs are copied whole, so encoding a slug into a reused buffer
+// allocates nothing.
+void encode_url_to(std::string_view s, std::string &out) {
+    size_t i = 0, n = s.size();
+    while (i < n) {
+        size_t run = url_plain_run(s.data() + i, n - i);
+        out.append(s.data() + i, run);
+        if ((i += run) == n) {
+            break;
+        }
+        uint8_t c = s[i++];
+        char escaped[3] = { '%', url_hex_digits[c >> 4], url_hex_digits[c & 15] };
+        out.append(escaped, 3);
+    }
+}
+// https://github.com/yhirose/cpp-httplib/blob/master/httplib.h#L1844
+std::string encode_url(std::string_view s) {
+    std::string result;
+    result.reserve(s.size());
+    encode_url_to(s, result);
     return result;
 }
-// https://github.com/yhirose/cpp-httplib/blob/master/httplib.h#L1875
-std::string decode_url(const std::string &s) {
+// Escapes everything but the RFC 3986 unreserved characters, for values
+// placed in a query string.
+std::string encode_url_component(const std::string &s) {
     std::string result;
     for (size_t i = 0; i < s.size(); i++) {
-        if (s[i] == '%' && i + 1 < s.size()) {
-            if (s[i + 1] == 'u') {
-                int val = 0;
-                if (from_hex_to_i(s, i + 2, 4, val)) {
-                    // 4 digits Unicode codes
-                    char buff[4];
-                    size_t len = to_utf8(val, buff);
-                    if (len > 0) {
-                        result.append(buff, len);
-                    }
-                    i += 5; // 'u0000'
-                } else {
-                    result += s[i];
-                }
-            } else {
-                int val = 0;
-                if (from_hex_to_i(s, i + 1, 2, val)) {
-                    // 2 digits hex codes
-                    result += static_cast<char>(val);
-                    i += 2; // '00'
-                } else {
-                    result += s[i];
-                }
-            }
-        } else if (s[i] == '+') {
-            result += ' ';
-        } else {
+        auto c = static_cast<uint8_t>(s[i]);
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
             result += s[i];
+        } else {
+            result += '%';
+            result += url_hex_digits[c >> 4];
+            result += url_hex_digits[c & 15];
         }
     }
     return result;
 }
+// Decodes s into out, which needs room for s.size() bytes and may be
+// s itself: the output never gets ahead of the input. Returns the decoded
+// length. "%XX" and "%uXXXX" are decoded, '+' is a space, and a '%' that
+// starts neither is kept.
+size_t decode_url_buffer(std::string_view s, char *out) {
+    const char *in = s.data();
+    size_t i = 0, o = 0, n = s.size();
+    while (i < n) {
+        size_t run = url_encoded_run(in + i, n - i);
+        if (out + o != in + i) {
+            memmove(out + o, in + i, run);
+        }
+        o += run;
+        if ((i += run) == n) {
+            break;
+        }
+        const signed char *hex = url_tables.hex;
+        if (in[i] == '+') {
+            out[o++] = ' ';
+            i++;
+        } else if (i + 2 < n && hex[(uint8_t)in[i + 1]] >= 0 && hex[(uint8_t)in[i + 2]] >= 0) {
+            // 2 digits hex codes
+            out[o++] = (char)(hex[(uint8_t)in[i + 1]] << 4 | hex[(uint8_t)in[i + 2]]);
+            i += 3;
+        } else if (i + 5 < n && in[i + 1] == 'u' && hex[(uint8_t)in[i + 2]] >= 0 && hex[(uint8_t)in[i + 3]] >= 0
+                && hex[(uint8_t)in[i + 4]] >= 0 && hex[(uint8_t)in[i + 5]] >= 0) {
+            // 4 digits Unicode codes, at most 3 bytes of UTF-8 for 6 read
+            int code = hex[(uint8_t)in[i + 2]] << 12 | hex[(uint8_t)in[i + 3]] << 8 | hex[(uint8_t)in[i + 4]] << 4 | hex[(uint8_t)in[i + 5]];
+            o += to_utf8(code, out + o);
+            i += 6;
+        } else {
+            out[o++] = in[i++];
+        }
+    }
+    return o;
+}
+// Appends the decoded s to out; s must not point into out.
+void decode_url_to(std::string_view s, std::string &out) {
+    size_t at = out.size();
+    out.resize(at + s.size());
+    out.resize(at + decode_url_buffer(s, &out[at]));
+}
+
+void decode_url_in_place(std::string &s) {
+    s.resize(decode_url_buffer(s, &s[0]));
+}
+// https://github.com/yhirose/cpp-httplib/blob/master/httplib.h#L1875
+std::string decode_url(std::string_view s) {
+    std::string result;
+    decode_url_to(s, result);
+    return result;
+}
 #endif
\ No newline at end of file